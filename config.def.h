@@ -58,6 +58,7 @@ static Command cmds[] = {
 	{ { "qall"                     }, cmd_qall,       CMD_OPT_FORCE },
 	{ { "quit", "q"                }, cmd_quit,       CMD_OPT_FORCE },
 	{ { "read",                    }, cmd_read,       CMD_OPT_FORCE },
+	{ { "recover"                  }, cmd_recover,    CMD_OPT_FORCE },
 	{ { "saveas"                   }, cmd_saveas,     CMD_OPT_FORCE },
 	{ { "set",                     }, cmd_set,        CMD_OPT_ARGS  },
 	{ { "split"                    }, cmd_split,      CMD_OPT_NONE  },
@@ -512,8 +513,10 @@ static void vis_mode_prompt_enter(Mode *old) {
 }
 
 static void vis_mode_prompt_leave(Mode *new) {
-	if (new->isuser)
+	if (new->isuser) {
+		isearch_stop();
 		editor_prompt_hide(vis);
+	}
 }
 
 static KeyBinding vis_mode_insert_register[] = {
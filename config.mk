@@ -33,6 +33,8 @@ else ifeq ($(shell uname),AIX)
 	CFLAGS += -D_ALL_SOURCE
 endif
 
+LIBS += -lpthread
+
 CFLAGS += -std=c99 -Os ${INCS} -DVERSION=\"${VERSION}\" -DNDEBUG -D_POSIX_C_SOURCE=200809L -D_XOPEN_SOURCE=700
 
 LDFLAGS += ${LIBS}
@@ -3,6 +3,11 @@
 #include <stdarg.h>
 #include <unistd.h>
 #include <errno.h>
+#include <time.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
 #include "editor.h"
 #include "util.h"
 
@@ -25,17 +30,10 @@ void editor_windows_arrange(Editor *ed, enum UiLayout layout) {
 }
 
 bool editor_window_reload(Win *win) {
-	const char *filename = text_filename_get(win->file->text);
 	/* can't reload unsaved file */
-	if (!filename)
-		return false;
-	File *file = file_new(win->editor, filename);
-	if (!file)
+	if (!text_filename_get(win->file->text))
 		return false;
-	file_free(win->editor, win->file);
-	win->file = file;
-	view_reload(win->view, file->text);
-	return true;
+	return editor_file_reload(win->editor, win->file);
 }
 
 bool editor_window_split(Win *original) {
@@ -45,6 +43,10 @@ bool editor_window_split(Win *original) {
 	win->file = original->file;
 	win->file->refcount++;
 	view_syntax_set(win->view, view_syntax_get(original->view));
+	win->large = original->large;
+	win->matchcount = original->matchcount;
+	if (win->large)
+		editor_window_options(win, UI_OPTION_LINE_NUMBERS_NONE);
 	view_cursor_to(win->view, view_cursor_get(original->view));
 	editor_draw(win->editor);
 	return true;
@@ -82,6 +84,63 @@ size_t editor_window_jumplist_next(Win *win) {
 	return cur;
 }
 
+#define JUMPLIST_SIZE 31
+
+/* positions of the jumplist marks of a window, used to recreate them */
+typedef struct {
+	Text *text;
+	size_t pos[JUMPLIST_SIZE];
+	int count;
+} Jumps;
+
+static const void *jumplist_save(void *data, const void *mark) {
+	Jumps *jumps = data;
+	if (jumps->count < JUMPLIST_SIZE)
+		jumps->pos[jumps->count++] = text_mark_get(jumps->text, mark);
+	return mark;
+}
+
+static const void *jumplist_restore(void *data, const void *mark) {
+	Jumps *jumps = data;
+	if (jumps->count < JUMPLIST_SIZE)
+		return text_mark_set(jumps->text, jumps->pos[jumps->count++]);
+	return NULL;
+}
+
+bool editor_file_rebase(Editor *ed, File *file, bool history) {
+	Text *txt = file->text;
+	size_t marks[MARK_LAST];
+	int count = 0;
+	for (Win *win = ed->windows; win; win = win->next)
+		count++;
+	Jumps *jumps = calloc(count, sizeof *jumps);
+	if (!jumps)
+		return false;
+	for (int i = 0; i < MARK_LAST; i++)
+		marks[i] = text_mark_get(txt, file->marks[i]);
+	count = 0;
+	for (Win *win = ed->windows; win; win = win->next, count++) {
+		jumps[count].text = txt;
+		if (win->file == file && win->jumplist)
+			ringbuf_map(win->jumplist, jumplist_save, &jumps[count]);
+	}
+
+	bool ret = text_rebase(txt, history);
+	if (ret) {
+		/* marks refer to the replaced data, recreate them */
+		for (int i = 0; i < MARK_LAST; i++)
+			file->marks[i] = text_mark_set(txt, marks[i]);
+		count = 0;
+		for (Win *win = ed->windows; win; win = win->next, count++) {
+			jumps[count].count = 0;
+			if (win->file == file && win->jumplist)
+				ringbuf_map(win->jumplist, jumplist_restore, &jumps[count]);
+		}
+	}
+	free(jumps);
+	return ret;
+}
+
 void editor_window_jumplist_invalidate(Win *win) {
 	if (win->jumplist)
 		ringbuf_invalidate(win->jumplist);
@@ -163,6 +222,237 @@ void editor_tabwidth_set(Editor *ed, int tabwidth) {
 	ed->tabwidth = tabwidth;
 }
 
+void editor_maxmem_set(Editor *ed, size_t maxmem) {
+	for (File *file = ed->files; file; file = file->next)
+		text_heap_limit_set(file->text, maxmem);
+	ed->maxmem = maxmem;
+}
+
+void editor_memlimit_set(Editor *ed, size_t memlimit) {
+	ed->memlimit = memlimit;
+	editor_evict(ed);
+}
+
+void editor_recovery_set(Editor *ed, bool enable) {
+	for (File *file = ed->files; file; file = file->next)
+		text_recovery_set(file->text, enable);
+	ed->recovery = enable;
+}
+
+/* get the directory name below $XDG_CACHE_HOME/vis, it is not created */
+static char *cache_dir(const char *name) {
+	char *dir;
+	const char *cache = getenv("XDG_CACHE_HOME");
+	const char *home = getenv("HOME");
+	const char *fmt = "%s/vis/%s";
+	if (!cache || !*cache) {
+		if (!home || !*home)
+			return NULL;
+		cache = home;
+		fmt = "%s/.cache/vis/%s";
+	}
+	size_t len = strlen(cache) + strlen(fmt) + strlen(name);
+	if (!(dir = malloc(len)))
+		return NULL;
+	snprintf(dir, len, fmt, cache, name);
+	return dir;
+}
+
+bool editor_undofile_set(Editor *ed, bool enable) {
+	char *dir = NULL;
+	if (enable && (!(dir = cache_dir("undo")) || !mkdirs(dir))) {
+		int error = errno;
+		free(dir);
+		errno = error;
+		return false;
+	}
+	for (File *file = ed->files; file; file = file->next)
+		text_history_dir_set(file->text, dir);
+	free(ed->undodir);
+	ed->undodir = dir;
+	return true;
+}
+
+bool editor_linecache_set(Editor *ed, bool enable) {
+	char *dir = NULL;
+	if (enable && !(dir = cache_dir("lines")))
+		return false;
+	for (File *file = ed->files; file; file = file->next)
+		text_lineindex_dir_set(file->text, dir);
+	free(ed->lineindexdir);
+	ed->lineindexdir = dir;
+	return true;
+}
+
+bool editor_file_follow(Editor *ed, File *file, bool enable) {
+	if (file->follow == enable)
+		return true;
+#ifdef __linux__
+	if (enable) {
+		const char *filename = text_filename_get(file->text);
+		if (!filename) {
+			errno = ENOENT;
+			return false;
+		}
+		if (ed->inotify == -1 && (ed->inotify = inotify_init1(IN_NONBLOCK|IN_CLOEXEC)) == -1)
+			return false;
+		if ((file->watch = inotify_add_watch(ed->inotify, filename, IN_MODIFY)) == -1)
+			return false;
+	} else {
+		inotify_rm_watch(ed->inotify, file->watch);
+	}
+	file->follow = enable;
+	return true;
+#else
+	errno = ENOTSUP;
+	return false;
+#endif
+}
+
+int editor_follow_fd(Editor *ed) {
+	for (File *file = ed->files; file; file = file->next) {
+		if (file->follow)
+			return ed->inotify;
+	}
+	return -1;
+}
+
+bool editor_follow_events(Editor *ed) {
+	bool events = false;
+#ifdef __linux__
+	char buf[4096];
+	while (read(ed->inotify, buf, sizeof buf) > 0)
+		events = true;
+#endif
+	return events;
+}
+
+/* file content read ahead of a viewport in the scroll direction */
+#define READAHEAD_SIZE (1 << 21)
+/* after a jump further than this, the content around the previous viewport is
+ * not expected to be needed soon unless it is close to another window */
+#define EVICT_DISTANCE (1 << 26)
+
+static size_t distance(Filerange *a, Filerange *b) {
+	if (a->end < b->start)
+		return b->start - a->end;
+	if (b->end < a->start)
+		return a->start - b->end;
+	return 0;
+}
+
+void editor_readahead(Editor *ed) {
+	for (Win *win = ed->windows; win; win = win->next) {
+		Text *txt = win->file->text;
+		Filerange view = view_viewport_get(win->view), prev = win->viewport;
+		Filerange *ahead = &win->readahead;
+		win->viewport = view;
+		if (view.start == prev.start)
+			continue;
+		if (view.start > prev.start) {
+			if (view.end < ahead->start || view.end + READAHEAD_SIZE / 2 > ahead->end) {
+				*ahead = (Filerange){ view.end, view.end + READAHEAD_SIZE };
+				text_advise(txt, ahead->start, READAHEAD_SIZE, TEXT_ADVICE_WILLNEED);
+			}
+		} else if (view.start > ahead->end || view.start < ahead->start + READAHEAD_SIZE / 2) {
+			size_t start = view.start - MIN(view.start, READAHEAD_SIZE);
+			*ahead = (Filerange){ start, view.start };
+			text_advise(txt, start, view.start - start, TEXT_ADVICE_WILLNEED);
+		}
+		if (distance(&view, &prev) < EVICT_DISTANCE || prev.start == prev.end)
+			continue;
+		bool needed = false;
+		for (Win *w = ed->windows; w && !needed; w = w->next)
+			needed = w != win && w->file == win->file && distance(&w->viewport, &prev) < EVICT_DISTANCE;
+		if (!needed) {
+			size_t start = prev.start - MIN(prev.start, READAHEAD_SIZE);
+			text_advise(txt, start, prev.end + READAHEAD_SIZE - start, TEXT_ADVICE_COLD);
+		}
+	}
+}
+
+void editor_evict(Editor *ed) {
+	if (!ed->memlimit)
+		return;
+	time_t now = time(NULL);
+	size_t used = 0;
+	for (File *file = ed->files; file; file = file->next) {
+		file->visible = false;
+		used += text_heap_size(file->text);
+	}
+	/* files are displayed by a window with a non zero height or the focused one */
+	for (Win *win = ed->windows; win; win = win->next) {
+		if (win == ed->win || view_height_get(win->view) > 0) {
+			win->file->visible = true;
+			win->file->shown = now;
+			win->file->evicted = false;
+		}
+	}
+	while (used > ed->memlimit) {
+		File *lru = NULL;
+		for (File *file = ed->files; file; file = file->next) {
+			if (!file->visible && !file->evicted && (!lru || file->shown < lru->shown))
+				lru = file;
+		}
+		if (!lru)
+			break;
+		used -= text_evict(lru->text);
+		lru->evicted = true;
+	}
+}
+
+void editor_search_highlight(Editor *ed, bool enable) {
+	ed->hlsearch = enable;
+	for (Win *win = ed->windows; win; win = win->next)
+		view_search_set(win->view, enable ? ed->search_pattern : NULL);
+}
+
+Regex *editor_regex_get(Editor *ed, const char *pattern, int cflags) {
+	RegexCache *cache = ed->regexes, entry;
+	int i;
+	for (i = 0; i < REGEX_CACHE_SIZE && cache[i].regex; i++) {
+		if (cache[i].cflags == cflags && !strcmp(cache[i].pattern, pattern))
+			goto found;
+	}
+	entry.regex = text_regex_new();
+	entry.pattern = strdup(pattern);
+	entry.cflags = cflags;
+	if (!entry.regex || !entry.pattern || text_regex_compile(entry.regex, entry.pattern, cflags)) {
+		text_regex_free(entry.regex);
+		free(entry.pattern);
+		return NULL;
+	}
+	if (i == REGEX_CACHE_SIZE) {
+		/* evict the least recently used entry */
+		i--;
+		if (cache[i].regex == ed->search_pattern)
+			i--;
+		text_regex_free(cache[i].regex);
+		free(cache[i].pattern);
+	}
+	cache[i] = entry;
+found:
+	/* move to front */
+	entry = cache[i];
+	memmove(cache + 1, cache, i * sizeof(RegexCache));
+	cache[0] = entry;
+	return entry.regex;
+}
+
+bool editor_search_pattern_set(Editor *ed, const char *pattern, int cflags) {
+	Regex *regex = editor_regex_get(ed, pattern, cflags);
+	if (!regex)
+		return false;
+	if (regex != ed->search_pattern) {
+		/* the match indices refer to the old pattern which might be evicted */
+		for (File *file = ed->files; file; file = file->next)
+			text_search_index(file->text, NULL);
+		ed->search_pattern = regex;
+	}
+	editor_search_highlight(ed, ed->hlsearch);
+	return true;
+}
+
 bool editor_syntax_load(Editor *ed, Syntax *syntaxes, Color *colors) {
 	bool success = true;
 	ed->syntaxes = syntaxes;
@@ -173,19 +463,10 @@ bool editor_syntax_load(Editor *ed, Syntax *syntaxes, Color *colors) {
 		color->attr |= COLOR_PAIR(ed->ui->color_get(color->fg, color->bg));
 	}
 
+	/* the highlighting rules are compiled once a window uses them */
 	for (Syntax *syn = syntaxes; syn && syn->name; syn++) {
 		if (regcomp(&syn->file_regex, syn->file, REG_EXTENDED|REG_NOSUB|REG_ICASE|REG_NEWLINE))
 			success = false;
-		for (int j = 0; j < LENGTH(syn->rules); j++) {
-			SyntaxRule *rule = &syn->rules[j];
-			if (!rule->rule)
-				break;
-			int cflags = REG_EXTENDED;
-			if (!rule->multiline)
-				cflags |= REG_NEWLINE;
-			if (regcomp(&rule->regex, rule->rule, cflags))
-				success = false;
-		}
 	}
 
 	return success;
@@ -194,12 +475,13 @@ bool editor_syntax_load(Editor *ed, Syntax *syntaxes, Color *colors) {
 void editor_syntax_unload(Editor *ed) {
 	for (Syntax *syn = ed->syntaxes; syn && syn->name; syn++) {
 		regfree(&syn->file_regex);
-		for (int j = 0; j < LENGTH(syn->rules); j++) {
+		for (int j = 0; syn->compiled && j < LENGTH(syn->rules); j++) {
 			SyntaxRule *rule = &syn->rules[j];
 			if (!rule->rule)
 				break;
 			regfree(&rule->regex);
 		}
+		syn->compiled = false;
 	}
 
 	ed->syntaxes = NULL;
@@ -238,13 +520,16 @@ static Win *window_new_file(Editor *ed, File *file) {
 		.data = win,
 		.selection = window_selection_changed,
 	};
-	win->jumplist = ringbuf_alloc(31);
+	win->jumplist = ringbuf_alloc(JUMPLIST_SIZE);
+	win->matchcount = true;
 	win->view = view_new(file->text, &win->events);
 	win->ui = ed->ui->window_new(ed->ui, win->view, file->text);
 	if (!win->jumplist || !win->view || !win->ui) {
 		window_free(win);
 		return NULL;
 	}
+	if (ed->hlsearch)
+		view_search_set(win->view, ed->search_pattern);
 	view_tabwidth_set(win->view, ed->tabwidth);
 	if (ed->windows)
 		ed->windows->prev = win;
@@ -261,7 +546,11 @@ static void file_free(Editor *ed, File *file) {
 	if (--file->refcount > 0)
 		return;
 	
+	editor_file_follow(ed, file, false);
 	text_free(file->text);
+	if (file->lazy)
+		map_delete(ed->lazy, file->lazy);
+	free(file->lazy);
 	
 	if (file->prev)
 		file->prev->next = file->next;
@@ -272,12 +561,21 @@ static void file_free(Editor *ed, File *file) {
 	free(file);
 }
 
+/* apply the editor wide settings to a newly loaded text */
+static void file_text_init(Editor *ed, Text *text) {
+	text_heap_limit_set(text, ed->maxmem);
+	text_history_dir_set(text, ed->undodir);
+	text_lineindex_dir_set(text, ed->lineindexdir);
+	text_recovery_set(text, ed->recovery);
+}
+
 static File *file_new_text(Editor *ed, Text *text) {
 	File *file = calloc(1, sizeof(*file));
 	if (!file)
 		return NULL;
 	file->text = text;
 	file->refcount++;
+	file_text_init(ed, text);
 	if (ed->files)
 		ed->files->prev = file;
 	file->next = ed->files;
@@ -287,11 +585,16 @@ static File *file_new_text(Editor *ed, Text *text) {
 
 static File *file_new(Editor *ed, const char *filename) {
 	if (filename) {
-		/* try to detect whether the same file is already open in another window
-		 * TODO: do this based on inodes */
-		for (File *file = ed->files; file; file = file->next) {
+		/* try to detect whether the same file is already open in another window,
+		 * possibly under another name (e.g. through a symlink or relative path) */
+		File *file = map_get(ed->lazy, filename);
+		if (file) {
+			file->refcount++;
+			return file;
+		}
+		for (file = ed->files; file; file = file->next) {
 			const char *name = text_filename_get(file->text);
-			if (name && strcmp(name, filename) == 0) {
+			if (name && (strcmp(name, filename) == 0 || text_file_same(file->text, filename))) {
 				file->refcount++;
 				return file;
 			}
@@ -315,6 +618,99 @@ static File *file_new(Editor *ed, const char *filename) {
 	return file;
 }
 
+/* number of bytes at the start of a file which are checked for long lines */
+#define LARGELINE_SAMPLE (1 << 20)
+
+/* whether the file exceeds the configured size or line length limit, the latter
+ * is only checked for the first few lines */
+static bool file_large(Editor *ed, File *file) {
+	Text *txt = file->text;
+	size_t size = text_size(txt);
+	if (ed->largefile && size > ed->largefile)
+		return true;
+	if (!ed->largeline)
+		return false;
+	size_t sample = MIN(size, MAX(4 * ed->largeline, LARGELINE_SAMPLE));
+	size_t len = 0, line = 0;
+	text_iterate(txt, it, 0) {
+		const char *start = it.text, *end = it.end;
+		if ((size_t)(end - start) > sample - len)
+			end = start + (sample - len);
+		len += end - start;
+		for (const char *nl; start < end; start = nl + 1) {
+			nl = memchr(start, '\n', end - start);
+			line += (nl ? nl : end) - start;
+			if (line > ed->largeline)
+				return true;
+			if (!nl)
+				break;
+			line = 0;
+		}
+		if (len >= sample)
+			break;
+	}
+	return false;
+}
+
+bool editor_file_reload(Editor *ed, File *file) {
+	Text *txt = file->text;
+	/* cursors are kept on the same line, unless it was changed */
+	for (Win *win = ed->windows; win; win = win->next) {
+		if (win->file == file)
+			win->reload = text_mark_set(txt, view_cursor_get(win->view));
+	}
+	file->changed = false;
+	if (text_reload(txt)) {
+		for (Win *win = ed->windows; win; win = win->next) {
+			if (win->file != file)
+				continue;
+			size_t pos = text_mark_get(txt, win->reload);
+			view_draw(win->view);
+			view_cursor_to(win->view, pos != EPOS ? pos : view_cursor_get(win->view));
+		}
+		return true;
+	}
+	/* the file was truncated in place, its mapped content is gone */
+	if (errno != ERANGE)
+		return false;
+	const char *filename = text_filename_get(file->text);
+	Text *text = filename ? text_load(filename) : NULL;
+	if (!text)
+		return false;
+	file_text_init(ed, text);
+	Text *old = file->text;
+	file->text = text;
+	memset(file->marks, 0, sizeof file->marks);
+	for (Win *win = ed->windows; win; win = win->next) {
+		if (win->file != file)
+			continue;
+		ringbuf_invalidate(win->jumplist);
+		win->changelist = (ChangeList){ 0 };
+		view_reload(win->view, text);
+	}
+	text_free(old);
+	return true;
+}
+
+/* enable the features suitable for the file, based on its size and name */
+static void window_file_detect(Win *win, const char *filename) {
+	Editor *ed = win->editor;
+	if (file_large(ed, win->file)) {
+		/* syntax highlighting and match counting have to be enabled explicitly */
+		win->large = true;
+		win->matchcount = false;
+		editor_window_options(win, UI_OPTION_LINE_NUMBERS_NONE);
+		return;
+	}
+	for (Syntax *syn = ed->syntaxes; syn && syn->name; syn++) {
+		if (!regexec(&syn->file_regex, filename, 0, NULL, 0)) {
+			if (!view_syntax_set(win->view, syn))
+				editor_info_show(ed, "Could not compile syntax definition: `%s'", syn->name);
+			break;
+		}
+	}
+}
+
 bool editor_window_new(Editor *ed, const char *filename) {
 	File *file = file_new(ed, filename);
 	if (!file)
@@ -325,13 +721,12 @@ bool editor_window_new(Editor *ed, const char *filename) {
 		return false;
 	}
 
-	if (filename) {
-		for (Syntax *syn = ed->syntaxes; syn && syn->name; syn++) {
-			if (!regexec(&syn->file_regex, filename, 0, NULL, 0)) {
-				view_syntax_set(win->view, syn);
-				break;
-			}
-		}
+	if (file->lazy) {
+		/* the file is already open in a window which was not yet displayed */
+		if (!editor_window_load(win))
+			return false;
+	} else if (filename) {
+		window_file_detect(win, filename);
 	}
 
 	editor_draw(ed);
@@ -339,6 +734,92 @@ bool editor_window_new(Editor *ed, const char *filename) {
 	return true;
 }
 
+bool editor_window_new_lazy(Editor *ed, const char *filename) {
+	/* lazy files are kept out of ed->files until they are loaded, looking
+	 * them up by name keeps startup linear in the number of arguments */
+	File *file = map_get(ed->lazy, filename);
+	for (File *f = ed->files; f && !file; f = f->next) {
+		const char *name = text_filename_get(f->text);
+		if (name && strcmp(name, filename) == 0)
+			file = f;
+	}
+	if (file) {
+		file->refcount++;
+	} else {
+		if (!(file = calloc(1, sizeof(*file))))
+			return false;
+		file->refcount++;
+		if (!(file->text = text_load(NULL)) || !(file->lazy = strdup(filename)) ||
+		    !map_put(ed->lazy, file->lazy, file)) {
+			free(file->lazy);
+			file->lazy = NULL;
+			file_free(ed, file);
+			return false;
+		}
+	}
+	if (!window_new_file(ed, file)) {
+		file_free(ed, file);
+		return false;
+	}
+	return true;
+}
+
+bool editor_window_load(Win *win) {
+	Editor *ed = win->editor;
+	File *file = win->file;
+	char *filename = file->lazy;
+	if (!filename)
+		return true;
+	map_delete(ed->lazy, filename);
+	file->lazy = NULL;
+	/* it might have been opened under another name in the meantime */
+	File *same = NULL;
+	for (File *f = ed->files; f && !same; f = f->next) {
+		if (text_filename_get(f->text) && text_file_same(f->text, filename))
+			same = f;
+	}
+	Text *text = NULL;
+	if (!same) {
+		text = text_load(filename);
+		if (!text && errno == ENOENT)
+			text = text_load(NULL);
+		if (!text) {
+			int error = errno;
+			free(filename);
+			errno = error;
+			return false;
+		}
+		text_filename_set(text, filename);
+		file_text_init(ed, text);
+		if (ed->files)
+			ed->files->prev = file;
+		file->next = ed->files;
+		ed->files = file;
+	}
+
+	Text *old = file->text;
+	if (text)
+		file->text = text;
+	for (Win *next, *w = ed->windows; w; w = next) {
+		next = w->next;
+		if (w->file != file)
+			continue;
+		if (same) {
+			w->file = same;
+			same->refcount++;
+			view_reload(w->view, same->text);
+			file_free(ed, file);
+		} else {
+			view_reload(w->view, text);
+		}
+		window_file_detect(w, filename);
+	}
+	if (!same)
+		text_free(old);
+	free(filename);
+	return true;
+}
+
 bool editor_window_new_fd(Editor *ed, int fd) {
 	Text *text = text_load_fd(fd);
 	if (!text)
@@ -383,6 +864,12 @@ Editor *editor_new(Ui *ui) {
 	ed->ui->init(ed->ui, ed);
 	ed->tabwidth = 8;
 	ed->expandtab = false;
+	ed->lineindexdir = cache_dir("lines");
+	ed->largefile = 256 << 20;
+	ed->largeline = 64 << 10;
+	ed->inotify = -1;
+	if (!(ed->lazy = map_new()))
+		goto err;
 	if (!(ed->prompt = calloc(1, sizeof(Win))))
 		goto err;
 	if (!(ed->prompt->file = calloc(1, sizeof(File))))
@@ -393,8 +880,6 @@ Editor *editor_new(Ui *ui) {
 		goto err;
 	if (!(ed->prompt->ui = ed->ui->prompt_new(ed->ui, ed->prompt->view, ed->prompt->file->text)))
 		goto err;
-	if (!(ed->search_pattern = text_regex_new()))
-		goto err;
 	return ed;
 err:
 	editor_free(ed);
@@ -408,7 +893,10 @@ void editor_free(Editor *ed) {
 		editor_window_close(ed->windows);
 	file_free(ed, ed->prompt->file);
 	window_free(ed->prompt);
-	text_regex_free(ed->search_pattern);
+	for (int i = 0; i < REGEX_CACHE_SIZE; i++) {
+		text_regex_free(ed->regexes[i].regex);
+		free(ed->regexes[i].pattern);
+	}
 	for (int i = 0; i < REG_LAST; i++)
 		register_release(&ed->registers[i]);
 	for (int i = 0; i < MACRO_LAST; i++)
@@ -417,7 +905,12 @@ void editor_free(Editor *ed) {
 	ed->ui->free(ed->ui);
 	map_free(ed->cmds);
 	map_free(ed->options);
+	map_free(ed->lazy);
 	buffer_release(&ed->buffer_repeat);
+	free(ed->undodir);
+	free(ed->lineindexdir);
+	if (ed->inotify != -1)
+		close(ed->inotify);
 	free(ed);
 }
 
@@ -490,6 +983,8 @@ void editor_info_hide(Editor *ed) {
 }
 
 void editor_window_options(Win *win, enum UiOption options) {
+	if (win->large)
+		options |= UI_OPTION_LARGE_FILE;
 	win->ui->options(win->ui, options);
 }
 
@@ -5,6 +5,7 @@
 #include <signal.h>
 #include <stddef.h>
 #include <stdbool.h>
+#include <time.h>
 
 typedef struct Editor Editor;
 typedef struct Win Win;
@@ -196,6 +197,14 @@ struct File {
 	Text *text;
 	int refcount;
 	Mark marks[MARK_LAST];
+	bool rebase;            /* whether to rebase onto the file once its background save completes */
+	bool follow;            /* whether data appended to the file is added to the text */
+	int watch;              /* inotify(7) watch descriptor of a followed file */
+	bool changed;           /* whether the user was told that the file changed on disk */
+	char *lazy;             /* file to load once a window shows it, until then the text is empty and not in Editor->files */
+	bool visible;           /* whether a window displayed it at the last editor_evict call */
+	time_t shown;           /* when a window last displayed the file */
+	bool evicted;           /* whether its data was moved out of memory since then */
 	File *next, *prev;
 };
 
@@ -212,10 +221,22 @@ struct Win {
 	ViewEvent events;
 	RingBuffer *jumplist;   /* LRU jump management */
 	ChangeList changelist;  /* state for iterating through least recently changes */
+	bool large;             /* whether the file is too large for costly features to be enabled by default */
+	bool matchcount;        /* whether all matches of a search are indexed to display their count */
+	Mark reload;            /* cursor position while the file is reloaded */
+	Filerange viewport;     /* viewport at the last editor_readahead call */
+	Filerange readahead;    /* region for which a read ahead was last requested */
 	Win *prev, *next;       /* neighbouring windows */
 };
 
 #define MACRO_LAST 26
+#define REGEX_CACHE_SIZE 16
+
+typedef struct {     /* a compiled regex together with the pattern it was created from */
+	char *pattern;
+	int cflags;
+	Regex *regex;
+} RegexCache;
 
 struct Editor {
 	Ui *ui;
@@ -229,14 +250,32 @@ struct Editor {
 	Win *prompt;                      /* 1-line height window to get user input */
 	Win *prompt_window;               /* window which was focused before prompt was shown */
 	char prompt_type;                 /* command ':' or search '/','?' prompt */
-	Regex *search_pattern;            /* last used search pattern */
+	Regex *search_pattern;            /* last used search pattern, NULL if none */
+	RegexCache regexes[REGEX_CACHE_SIZE]; /* compiled regexes, most recently used first */
 	char search_char[8];              /* last used character to search for via 'f', 'F', 't', 'T' */
 	int last_totill;                  /* last to/till movement used for ';' and ',' */
 	int tabwidth;                     /* how many spaces should be used to display a tab */
 	bool expandtab;                   /* whether typed tabs should be converted to spaces */
 	bool autoindent;                  /* whether indentation should be copied from previous line on newline */
+	bool hlsearch;                    /* whether all matches of the search pattern should be highlighted */
+	size_t maxmem;                    /* heap memory per file for modifications, beyond it is file backed */
+	size_t memlimit;                  /* heap memory of all files, beyond it hidden ones are evicted */
+	bool inplace;                     /* whether :w only overwrites the modified part of a file */
+	char *undodir;                    /* where undo histories are persisted, NULL if disabled */
+	bool recovery;                    /* whether unsaved modifications are journaled */
+	size_t largefile;                 /* files larger than this are opened in large file mode, 0 disables */
+	size_t largeline;                 /* so are files with lines longer than this at their start */
+	int inotify;                      /* inotify(7) instance watching followed files, -1 if none */
+	bool autoreload;                  /* whether unmodified files changed on disk are reloaded */
+	char *lineindexdir;               /* where line indices of large files are cached or NULL */
+	enum {
+		REBASE_OFF,                   /* keep referring to the data a file was built from */
+		REBASE_KEEP,                  /* after :w refer to the written file, keep undo history */
+		REBASE_DROP,                  /* same but also drop the history and the memory it uses */
+	} rebase;
 	Map *cmds;                        /* ":"-commands, used for unique prefix queries */
 	Map *options;                     /* ":set"-options */
+	Map *lazy;                        /* files not yet loaded by name, they are not part of files */
 	Buffer buffer_repeat;             /* holds data to repeat last insertion/replacement */
 	
 	Action action;       /* current action which is in progress */
@@ -245,7 +284,7 @@ struct Editor {
 	Mode *mode_prev;     /* previsouly active user mode */
 	Mode *mode_before_prompt; /* user mode which was active before entering prompt */
 	volatile bool running; /* exit main loop once this becomes false */
-	volatile sig_atomic_t cancel_filter; /* abort external command */
+	volatile sig_atomic_t cancelled; /* abort long running operation */
 };
 
 Editor *editor_new(Ui*);
@@ -267,6 +306,48 @@ void editor_delete(Editor*, size_t pos, size_t len);
 /* set tabwidth (must be in range [1, 8], affects all windows */
 void editor_tabwidth_set(Editor*, int tabwidth);
 int editor_tabwidth_get(Editor*);
+/* limit the heap memory used to store modifications of every file, 0 for no limit */
+void editor_maxmem_set(Editor*, size_t maxmem);
+/* limit the heap memory used by all files together, 0 for no limit (see editor_evict) */
+void editor_memlimit_set(Editor*, size_t memlimit);
+/* persist the undo history of files in $XDG_CACHE_HOME/vis/undo */
+bool editor_undofile_set(Editor*, bool enable);
+/* cache the line index of large files in $XDG_CACHE_HOME/vis/lines (the default) */
+bool editor_linecache_set(Editor*, bool enable);
+/* record unsaved modifications of all files such that they can be recovered */
+void editor_recovery_set(Editor*, bool enable);
+/* watch the file for appended data which is then added by text_follow */
+bool editor_file_follow(Editor*, File*, bool enable);
+/* replace the text by the current content of the file as one undoable action,
+ * unchanged lines keep their marks. only if the file was truncated in place it
+ * is loaded anew, modifications, marks and the undo history are then lost */
+bool editor_file_reload(Editor*, File*);
+/* a file descriptor which becomes readable once a followed file was modified,
+ * editor_follow_events should then be called. -1 if no file is followed */
+int editor_follow_fd(Editor*);
+/* consume the pending modification events, returns whether there were any */
+bool editor_follow_events(Editor*);
+/* hint the kernel about the file content which is needed next, based on how
+ * the windows were scrolled since the last call. it is read ahead in the scroll
+ * direction, the surroundings of viewports left far behind may be evicted */
+void editor_readahead(Editor*);
+/* while the files use more heap memory than the limit, evict the data of the one
+ * which was least recently displayed in a window (see text_evict). it is read back
+ * once the file is displayed again. */
+void editor_evict(Editor*);
+/* rebase the text onto the file it was just saved to (see text_rebase),
+ * marks and jumplist entries are preserved */
+bool editor_file_rebase(Editor*, File*, bool history);
+
+/* enable/disable highlighting of all search pattern matches in all windows */
+void editor_search_highlight(Editor*, bool enable);
+/* get a compiled regex for the given pattern and flags. recently used ones are
+ * cached and only compiled once. the regex is owned by the cache and remains
+ * valid until REGEX_CACHE_SIZE other patterns were requested, the current search
+ * pattern is never evicted. returns NULL if the pattern is invalid. */
+Regex *editor_regex_get(Editor*, const char *pattern, int cflags);
+/* make pattern the current search pattern, returns false if it is invalid */
+bool editor_search_pattern_set(Editor*, const char *pattern, int cflags);
 
 /* load a set of syntax highlighting definitions which will be associated
  * to the underlying window based on the file type loaded.
@@ -281,6 +362,13 @@ void editor_syntax_unload(Editor*);
  * in another window, share the underlying text that is changes will be
  * visible in both windows */
 bool editor_window_new(Editor*, const char *filename);
+/* like editor_window_new but the file is neither accessed nor is its syntax
+ * detected until the window is loaded by editor_window_load */
+bool editor_window_new_lazy(Editor*, const char *filename);
+/* load the file of a window created by editor_window_new_lazy, all windows
+ * showing it are updated. returns false if it could not be loaded in which
+ * case the window shows an empty, unnamed text */
+bool editor_window_load(Win*);
 bool editor_window_new_fd(Editor*, int fd);
 /* reload the file currently displayed in the window from disk */
 bool editor_window_reload(Win*);
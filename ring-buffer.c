@@ -73,6 +73,11 @@ void ringbuf_invalidate(RingBuffer *buf) {
 	buf->iterating = false;
 }
 
+void ringbuf_map(RingBuffer *buf, const void *(*map)(void *data, const void *value), void *data) {
+	for (int i = buf->start; i != buf->end; i = ringbuf_index_next(buf, i))
+		buf->data[i] = map(data, buf->data[i]);
+}
+
 RingBuffer *ringbuf_alloc(size_t size) {
 	RingBuffer *buf;
 	if ((buf = calloc(1, sizeof(*buf) + (++size)*sizeof(buf->data[0]))))
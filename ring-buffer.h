@@ -17,5 +17,7 @@ void ringbuf_add(RingBuffer*, const void *value);
 const void *ringbuf_prev(RingBuffer*);
 const void *ringbuf_next(RingBuffer*);
 void ringbuf_invalidate(RingBuffer*);
+/* replace every element, from oldest to newest, by the value returned by map */
+void ringbuf_map(RingBuffer*, const void *(*map)(void *data, const void *value), void *data);
 
 #endif
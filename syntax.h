@@ -22,6 +22,7 @@ struct Syntax {               /* a syntax definition */
 	regex_t file_regex;   /* compiled file name regex */
 	const char **settings;/* settings associated with this file type */
 	SyntaxRule rules[24]; /* all rules for this file type */
+	bool compiled;        /* whether the rules are compiled, done upon first use */
 };
 
 #endif
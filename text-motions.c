@@ -335,6 +335,10 @@ size_t text_bracket_match(Text *txt, size_t pos) {
 }
 
 size_t text_bracket_match_except(Text *txt, size_t pos, const char *except) {
+	return text_bracket_match_range(txt, pos, except, &(Filerange){ .start = 0, .end = EPOS });
+}
+
+size_t text_bracket_match_range(Text *txt, size_t pos, const char *except, Filerange *r) {
 	int direction, count = 1;
 	char search, current, c;
 	Iterator it = text_iterator_get(txt, pos);
@@ -370,14 +374,14 @@ size_t text_bracket_match_except(Text *txt, size_t pos, const char *except) {
 	}
 
 	if (direction >= 0) { /* forward search */
-		while (text_iterator_byte_next(&it, &c)) {
+		while (text_iterator_byte_next(&it, &c) && it.pos < r->end) {
 			if (c == search && --count == 0)
 				return it.pos;
 			else if (c == current)
 				count++;
 		}
 	} else { /* backwards */
-		while (text_iterator_byte_prev(&it, &c)) {
+		while (text_iterator_byte_prev(&it, &c) && it.pos >= r->start) {
 			if (c == search && --count == 0)
 				return it.pos;
 			else if (c == current)
@@ -389,6 +393,9 @@ size_t text_bracket_match_except(Text *txt, size_t pos, const char *except) {
 }
 
 size_t text_search_forward(Text *txt, size_t pos, Regex *regex) {
+	size_t match_pos = text_search_index_next(txt, pos, regex);
+	if (match_pos != EPOS)
+		return match_pos;
 	int start = pos + 1;
 	int end = text_size(txt);
 	RegexMatch match[1];
@@ -404,6 +411,9 @@ size_t text_search_forward(Text *txt, size_t pos, Regex *regex) {
 }
 
 size_t text_search_backward(Text *txt, size_t pos, Regex *regex) {
+	size_t match_pos = text_search_index_prev(txt, pos, regex);
+	if (match_pos != EPOS)
+		return match_pos;
 	int start = 0;
 	int end = pos;
 	RegexMatch match[1];
@@ -13,36 +13,85 @@
  * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
+#ifdef __linux__
+/* for copy_file_range(2) */
+#define _GNU_SOURCE
+#endif
 #include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include <time.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <regex.h>
+#include <signal.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
+#include <sys/uio.h>
 
 #include "text.h"
 #include "util.h"
 
-#define BUFFER_SIZE (1 << 20)
+/* buffers holding inserted data start small and double in size up to the maximum */
+#define BUFFER_SIZE_MIN (1 << 12)
+#define BUFFER_SIZE_MAX (1 << 20)
+/* long running operations report their progress after processing this many bytes */
+#define PROGRESS_INTERVAL (1 << 20)
+/* maximal number of modified pieces written with one writev(2) call */
+#define WRITEV_BATCH 64
+/* recorded modifications are written once this many bytes are pending */
+#define RECOVERY_BUFFER (1 << 16)
+#define RECOVERY_MAGIC "visrcvr1"
+/* distance in bytes between two checkpoints of the line index */
+#define LINEINDEX_STEP (1 << 18)
+/* files smaller than this are not indexed, counting their lines is fast enough */
+#define LINEINDEX_MIN (1 << 24)
+#define LINEINDEX_MAGIC "vislidx1"
+/* changes of a reloaded file up to this size are copied, larger ones are mapped */
+#define RELOAD_COPY_MAX (1 << 20)
+/* granularity in which the current and reloaded content are compared */
+#define RELOAD_BLOCK_SIZE (1 << 12)
+/* data appended to a followed file is mapped in chunks of at least this size */
+#define FOLLOW_MAP_SIZE (1 << 24)
+/* maximal number of threads counting lines in parallel */
+#define LINEINDEX_THREADS 16
+
+#if defined(__GLIBC__)
+#if __GLIBC_PREREQ(2, 27)
+#define HAVE_COPY_FILE_RANGE 1
+#endif
+#endif
+#ifndef HAVE_COPY_FILE_RANGE
+#define HAVE_COPY_FILE_RANGE 0
+#endif
+
+/* sub-second part of the modification time, POSIX.1-2008 names it st_mtim */
+#if defined(__APPLE__)
+#define MTIME_NSEC(st) ((st)->st_mtimespec.tv_nsec)
+#else
+#define MTIME_NSEC(st) ((st)->st_mtim.tv_nsec)
+#endif
 
 struct Regex {
 	const char *string;
 	regex_t regex;
+	int generation;         /* unique among all regexes, changes whenever it is recompiled */
 };
 
 /* Buffer holding the file content, either readonly mmap(2)-ed from the original
- * file or heap allocated to store the modifications.
+ * file or heap allocated (or mapped from a temporary file) to store the modifications.
  */
 typedef struct Buffer Buffer;
 struct Buffer {
 	size_t size;            /* maximal capacity */
 	size_t len;             /* current used length / insertion position */
 	char *data;             /* actual data */
+	bool mapped;            /* data is a file mapping rather than anonymous memory */
+	bool readonly;          /* data is mapped without write access, never append to it */
 	Buffer *next;           /* next junk */
 };
 
@@ -102,6 +151,101 @@ typedef struct {
 	size_t lineno;          /* line number in file i.e. number of '\n' in [0, pos) */
 } LineCache;
 
+/* counts the new lines of consecutive LINEINDEX_STEP sized regions of buf */
+typedef struct {
+	pthread_t thread;
+	bool running;           /* whether the thread was started, otherwise steps are counted on demand */
+	const char *data;       /* start of the first region */
+	size_t steps;           /* number of regions */
+	uint64_t *lines;        /* lines[i] receives the number of '\n' in the i-th region */
+	pthread_mutex_t *lock;  /* protects cancel */
+	bool *cancel;           /* whether the result is no longer needed */
+} LineIndexWorker;
+
+/* number of new lines preceding every LINEINDEX_STEP-th byte of the original
+ * file content, used to skip over large unmodified regions when counting lines */
+typedef struct {
+	uint64_t *lines;        /* lines[i] number of '\n' in the first i*LINEINDEX_STEP bytes */
+	size_t count;           /* number of checkpoints, buf.size / LINEINDEX_STEP + 1 */
+	bool failed;            /* whether building the index failed, it is then not retried */
+	LineIndexWorker *workers; /* threads building the index in the background or NULL */
+	int nworkers;
+	uint64_t *counts;       /* per region counts of the workers, becomes lines once they are done */
+	pthread_mutex_t lock;
+	bool cancel;
+} LineIndex;
+
+typedef struct {
+	char magic[8];
+	uint64_t dev, ino;      /* file the index belongs to */
+	uint64_t size;          /* file size at the time the index was built */
+	int64_t mtime, mtime_nsec; /* modification time of the file */
+	uint64_t step;          /* LINEINDEX_STEP */
+	uint64_t count;         /* number of checkpoints following the header */
+} LineIndexHeader;
+
+/* A sorted index of all matches of a regex. It is built incrementally by scanning
+ * the dirty region in chunks. Modifications only invalidate the affected lines
+ * which are added to the dirty region, all other matches are kept but moved.
+ */
+typedef struct {
+	Regex *regex;           /* pattern whose matches are indexed or NULL */
+	int generation;         /* generation of the regex when indexing started */
+	RegexMatch *matches;    /* sorted array of non overlapping matches */
+	size_t count;           /* number of stored matches */
+	size_t size;            /* number of allocated array elements */
+	Filerange dirty;        /* region which still needs to be scanned, invalid once complete */
+	bool failed;            /* whether memory ran out, the index then stays incomplete */
+} MatchIndex;
+
+/* Unsaved modifications are recorded in a journal from which they can be
+ * recovered after an abnormal exit. The records are collected in memory and
+ * appended to the file in batches. A journal left by a previous session is
+ * never overwritten, until it is either recovered or discarded the records
+ * are written to a separate file.
+ */
+typedef struct {
+	char magic[8];
+	uint64_t size;          /* size of the file to which the records apply */
+	int64_t mtime, mtime_nsec; /* its modification time */
+} RecoveryHeader;
+
+/* the replacement of deleted bytes at pos, followed by the inserted bytes */
+typedef struct {
+	uint64_t pos, deleted, inserted;
+} RecoveryRecord;
+
+typedef struct {
+	bool enabled;           /* whether modifications are recorded */
+	bool checked;           /* whether it was already looked for a previous journal */
+	bool previous;          /* whether one exists, records then go to `filename~recover.new' */
+	int fd;                 /* the journal file, -1 until the first modification */
+	char *data;             /* records which were not yet written */
+	size_t len;             /* their total size */
+	size_t size;            /* allocated size of data */
+} Recovery;
+
+/* State of a save operation running in a background thread. It writes a
+ * snapshot of the piece chain, thus the text can be modified meanwhile.
+ */
+typedef struct {
+	Text *text;             /* text being saved */
+	pthread_t thread;
+	pthread_mutex_t lock;   /* protects done */
+	int pipe[2];            /* a byte is written to pipe[1] once the thread is done */
+	struct iovec *pieces;   /* snapshot of the content to save */
+	size_t count;           /* number of pieces */
+	size_t size;            /* total number of bytes to save */
+	size_t done;            /* number of bytes already saved */
+	int fd;                 /* temporary file being written to */
+	char *tmpname;          /* its name */
+	char *filename;         /* final destination */
+	Action *action;         /* most recent action at the time of the snapshot */
+	bool whole;             /* whether the whole text is saved */
+	bool success;           /* whether the save succeeded, valid once the thread is done */
+	int error;              /* errno of a failed save */
+} Save;
+
 /* The main struct holding all information of a given file */
 struct Text {
 	Buffer buf;             /* original mmap(2)-ed file content at the time of load operation */
@@ -117,11 +261,32 @@ struct Text {
 	char *filename;         /* filename of which data was loaded */
 	struct stat info;	/* stat as proped on load time */
 	int fd;                 /* the file descriptor of the original mmap-ed data */
+	bool loading;           /* whether more data is still to be read from fd */
 	LineCache lines;        /* mapping between absolute pos in bytes and logical line breaks */
+	LineIndex lineindex;    /* line checkpoints of buf, built once lines of a large file are counted */
+	char *lineindex_dir;    /* directory where line indices are cached or NULL */
 	enum TextNewLine newlines; /* which type of new lines does the file use */
+	size_t revision;        /* incremented upon every modification of the text content */
+	MatchIndex matches;     /* matches of the most recently used search pattern */
+	bool (*progress)(void *data, size_t done, size_t total); /* periodically called by long operations */
+	void *progress_data;    /* user supplied argument passed to the progress callback */
+	Filerange stale;        /* region of buf which no longer matches the file on disk */
+	Save *save;             /* background save in progress or NULL */
+	size_t buffer_size;     /* size of the next allocated buffer, grows geometrically */
+	size_t heap_size;       /* total size of all heap allocated buffers */
+	size_t heap_limit;      /* further buffers are file backed once this is exceeded, 0 for no limit */
+	struct stat saved_info; /* stat of filename when its content last matched the saved action */
+	char *history_dir;      /* directory where the undo history is persisted or NULL */
+	bool history_restored;  /* whether a persisted undo history was already looked for */
+	Recovery recovery;      /* journal of unsaved modifications */
+	bool journal;           /* whether an interrupted in-place save left a journal */
+	size_t followed;        /* size of the file content which is part of the text */
+	Buffer *follow;         /* mapping of the data appended to the file since it was loaded */
+	size_t follow_off;      /* file offset of follow->data */
 };
 
 /* buffer management */
+static char *buffer_mmap(size_t size);
 static Buffer *buffer_alloc(Text *txt, size_t size);
 static void buffer_free(Buffer *buf);
 static bool buffer_capacity(Buffer *buf, size_t len);
@@ -149,23 +314,90 @@ static void change_free(Change *c);
 /* action management */
 static Action *action_alloc(Text *txt);
 static void action_free(Action *a);
+static void action_reverse(Action *a);
 static void action_push(Action **stack, Action *action);
 static Action *action_pop(Action **stack);
+/* match index management */
+static void index_change(Text *txt, size_t pos, size_t deleted, size_t inserted);
+/* notify all cached information about a replacement of [pos, pos+deleted) by inserted bytes */
+static void text_changed(Text *txt, size_t pos, size_t deleted, size_t inserted);
+/* report progress of a long running operation, returns false if it should be aborted */
+static bool text_progress(Text *txt, size_t done, size_t total);
 /* logical line counting cache */
 static void lineno_cache_invalidate(LineCache *cache);
 static size_t lines_skip_forward(Text *txt, size_t pos, size_t lines, size_t *lines_skiped);
 static size_t lines_count(Text *txt, size_t pos, size_t len);
+static void lineindex_start(Text *txt);
+static bool lineindex_load(Text *txt);
+static void lineindex_free(Text *txt);
+/* whether both refer to the same, unchanged file */
+static bool stat_same(const struct stat *a, const struct stat *b);
+/* persistent undo history */
+static void history_restore(Text *txt);
+static void history_remove(Text *txt);
+static bool history_store(Text *txt);
+/* crash recovery journal */
+static void recovery_record(Text *txt, size_t pos, size_t deleted, size_t inserted);
+static void recovery_reset(Text *txt);
+static void recovery_remove(Text *txt);
+
+/* create an unlinked temporary file of size bytes, returns its fd or -1 */
+static int buffer_tmpfile(size_t size) {
+	char name[4096];
+	const char *tmp = getenv("TMPDIR");
+	if (snprintf(name, sizeof name, "%s/.vis.XXXXXX", tmp && *tmp ? tmp : "/var/tmp") >= (int)sizeof name)
+		return -1;
+	int fd = mkstemp(name);
+	if (fd == -1)
+		return -1;
+	unlink(name);
+	/* reserve the disk space, writing to a sparse mapping could raise SIGBUS */
+	if (posix_fallocate(fd, 0, size)) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/* map size bytes of an unlinked temporary file, the kernel can then write cold
+ * data back to disk instead of having to keep it in anonymous memory */
+static char *buffer_mmap(size_t size) {
+	int fd = buffer_tmpfile(size);
+	if (fd == -1)
+		return NULL;
+	char *data = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	return data == MAP_FAILED ? NULL : data;
+}
 
-/* allocate a new buffer of MAX(size, BUFFER_SIZE) bytes */
+/* allocate a new buffer of at least size bytes, each one is twice as large as
+ * the previous one up to BUFFER_SIZE_MAX such that small texts only occupy a few
+ * pages. it is file backed if the heap limit of the text would otherwise be exceeded.
+ * otherwise it is anonymous memory of whole pages, text_evict can then replace it
+ * by a file mapping at the same address. */
 static Buffer *buffer_alloc(Text *txt, size_t size) {
 	Buffer *buf = calloc(1, sizeof(Buffer));
 	if (!buf)
 		return NULL;
-	if (BUFFER_SIZE > size)
-		size = BUFFER_SIZE;
-	if (!(buf->data = malloc(size))) {
-		free(buf);
-		return NULL;
+	if (txt->buffer_size < BUFFER_SIZE_MIN)
+		txt->buffer_size = BUFFER_SIZE_MIN;
+	if (txt->buffer_size > size)
+		size = txt->buffer_size;
+	if (txt->buffer_size < BUFFER_SIZE_MAX)
+		txt->buffer_size *= 2;
+	size_t pagesize = sysconf(_SC_PAGESIZE);
+	size += pagesize - 1 - (size + pagesize - 1) % pagesize;
+	if (txt->heap_limit && txt->heap_size + size > txt->heap_limit) {
+		buf->data = buffer_mmap(size);
+		buf->mapped = buf->data != NULL;
+	}
+	if (!buf->data) {
+		buf->data = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+		if (buf->data == MAP_FAILED) {
+			free(buf);
+			return NULL;
+		}
+		txt->heap_size += size;
 	}
 	buf->size = size;
 	buf->next = txt->buffers;
@@ -173,16 +405,149 @@ static Buffer *buffer_alloc(Text *txt, size_t size) {
 	return buf;
 }
 
+/* pass the advice for the len bytes of mapped memory at data to the kernel */
+static void memory_advise(const char *data, size_t len, enum TextAdvice advice) {
+	size_t pagesize = sysconf(_SC_PAGESIZE);
+	size_t off = (uintptr_t)data % pagesize;
+	void *addr = (char*)data - off;
+	len += off;
+	switch (advice) {
+	case TEXT_ADVICE_NORMAL:
+		posix_madvise(addr, len, POSIX_MADV_NORMAL);
+		break;
+	case TEXT_ADVICE_SEQUENTIAL:
+		posix_madvise(addr, len, POSIX_MADV_SEQUENTIAL);
+		break;
+	case TEXT_ADVICE_WILLNEED:
+		posix_madvise(addr, len, POSIX_MADV_WILLNEED);
+		break;
+	case TEXT_ADVICE_COLD:
+#ifdef __linux__
+		/* deactivate the pages, older kernels only support dropping them
+		 * from the mapping which is fine for a read only file mapping */
+#ifdef MADV_COLD
+		if (madvise(addr, len, MADV_COLD) == 0)
+			break;
+#endif
+		madvise(addr, len, MADV_DONTNEED);
+#else
+		posix_madvise(addr, len, POSIX_MADV_DONTNEED);
+#endif
+		break;
+	}
+}
+
+/* advise on the part of [data, data+len) which lies within the file mapping
+ * or a file backed buffer holding inserted data */
+static void buffer_advise(Text *txt, const char *data, size_t len, enum TextAdvice advice) {
+	const char *map = txt->buf.data, *end = map + txt->buf.size;
+	if (!map || data < map || data >= end) {
+		Buffer *buf = txt->buffers;
+		while (buf && (!buf->mapped || data < buf->data || data >= buf->data + buf->len))
+			buf = buf->next;
+		if (!buf)
+			return;
+		end = buf->data + buf->len;
+	}
+	if (len)
+		memory_advise(data, MIN(len, (size_t)(end - data)), advice);
+}
+
+void text_advise(Text *txt, size_t pos, size_t len, enum TextAdvice advice) {
+	if (pos >= txt->size)
+		return;
+	Location loc = piece_get_extern(txt, pos);
+	size_t off = loc.off;
+	for (Piece *p = loc.piece; p && p != &txt->end && len > 0; p = p->next, off = 0) {
+		size_t n = MIN(p->len - off, len);
+		buffer_advise(txt, p->data + off, n, advice);
+		len -= n;
+	}
+}
+
+/* wrap the readonly mapped file content of size bytes in a buffer. it is never
+ * appended to and linked after the most recent one which is used to cache
+ * consecutive insertions */
+static Buffer *buffer_mapped(Text *txt, char *data, size_t size) {
+	Buffer *buf = calloc(1, sizeof(Buffer));
+	if (!buf)
+		return NULL;
+	buf->data = data;
+	buf->size = buf->len = size;
+	buf->mapped = true;
+	buf->readonly = true;
+	if (txt->buffers) {
+		buf->next = txt->buffers->next;
+		txt->buffers->next = buf;
+	} else {
+		txt->buffers = buf;
+	}
+	return buf;
+}
+
 static void buffer_free(Buffer *buf) {
 	if (!buf)
 		return;
-	free(buf->data);
+	munmap(buf->data, buf->size);
 	free(buf);
 }
 
+/* replace the anonymous memory of the buffer by a mapping of an unlinked temporary
+ * file with the same content at the same address, hence pointers into it stay valid */
+static bool buffer_swap(Buffer *buf) {
+	int fd = buffer_tmpfile(buf->size);
+	if (fd == -1)
+		return false;
+	for (size_t done = 0; done < buf->len; ) {
+		ssize_t n = pwrite(fd, buf->data + done, buf->len - done, done);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n <= 0) {
+			close(fd);
+			return false;
+		}
+		done += n;
+	}
+	char *data = mmap(buf->data, buf->size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_FIXED, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+		return false;
+	buf->mapped = true;
+	return true;
+}
+
+/* drop the pages of mapped memory such that they are read back from the file
+ * once needed, dirty pages of a shared mapping are written back first */
+static void memory_release(const char *data, size_t len) {
+#ifdef MADV_PAGEOUT
+	size_t pagesize = sysconf(_SC_PAGESIZE);
+	size_t off = (uintptr_t)data % pagesize;
+	if (madvise((char*)data - off, len + off, MADV_PAGEOUT) == 0)
+		return;
+#endif
+	memory_advise(data, len, TEXT_ADVICE_COLD);
+}
+
+size_t text_evict(Text *txt) {
+	size_t released = 0;
+	if (txt->loading || txt->save)
+		return 0;
+	for (Buffer *buf = txt->buffers; buf; buf = buf->next) {
+		if (!buf->mapped && buffer_swap(buf)) {
+			txt->heap_size -= buf->size;
+			released += buf->size;
+		}
+		if (buf->mapped && buf->len)
+			memory_release(buf->data, buf->len);
+	}
+	if (txt->buf.data && txt->buf.size)
+		memory_release(txt->buf.data, txt->buf.size);
+	return released;
+}
+
 /* check whether buffer has enough free space to store len bytes */
 static bool buffer_capacity(Buffer *buf, size_t len) {
-	return buf->size - buf->len >= len;
+	return !buf->readonly && buf->size - buf->len >= len;
 }
 
 /* append data to buffer, assumes there is enough space available */
@@ -368,6 +733,17 @@ static void action_free(Action *a) {
 	free(a);
 }
 
+/* reverse the order of the changes, used to replay them in chronological order */
+static void action_reverse(Action *a) {
+	Change *prev = NULL;
+	for (Change *next, *c = a->change; c; c = next) {
+		next = c->next;
+		c->next = prev;
+		prev = c;
+	}
+	a->change = prev;
+}
+
 static Piece *piece_alloc(Text *txt) {
 	Piece *p = calloc(1, sizeof(Piece));
 	if (!p)
@@ -500,28 +876,15 @@ static void change_free(Change *c) {
  *      | |     |short|     | existing text |     | |
  *      \-+ <-- +-----+ <-- +---------------+ <-- +-/
  */
-bool text_insert(Text *txt, size_t pos, const char *data, size_t len) {
-	if (len == 0)
-		return true;
-	if (pos > txt->size)
-		return false;
-	if (pos < txt->lines.pos)
-		lineno_cache_invalidate(&txt->lines);
-
-	Location loc = piece_get_intern(txt, pos);
+/* insert a new piece referring to already stored data at pos which is
+ * located at loc. returns the new piece or NULL on failure. */
+static Piece *piece_insert(Text *txt, size_t pos, Location loc, const char *data, size_t len) {
 	Piece *p = loc.piece;
-	if (!p)
-		return false;
 	size_t off = loc.off;
-	if (cache_insert(txt, p, off, data, len))
-		return true;
 
 	Change *c = change_alloc(txt, pos);
 	if (!c)
-		return false;
-
-	if (!(data = buffer_store(txt, data, len)))
-		return false;
+		return NULL;
 
 	Piece *new = NULL;
 
@@ -529,7 +892,7 @@ bool text_insert(Text *txt, size_t pos, const char *data, size_t len) {
 		/* insert between two existing pieces, hence there is nothing to
 		 * remove, just add a new piece holding the extra text */
 		if (!(new = piece_alloc(txt)))
-			return false;
+			return NULL;
 		piece_init(new, p, p->next, data, len);
 		span_init(&c->new, new, new);
 		span_init(&c->old, NULL, NULL);
@@ -543,7 +906,7 @@ bool text_insert(Text *txt, size_t pos, const char *data, size_t len) {
 		new = piece_alloc(txt);
 		Piece *after = piece_alloc(txt);
 		if (!before || !new || !after)
-			return false;
+			return NULL;
 		piece_init(before, p->prev, new, p->data, off);
 		piece_init(new, before, after, data, len);
 		piece_init(after, new, p->next, p->data + off, p->len - off);
@@ -552,13 +915,250 @@ bool text_insert(Text *txt, size_t pos, const char *data, size_t len) {
 		span_init(&c->old, p, p);
 	}
 
-	cache_piece(txt, new);
 	span_swap(txt, &c->old, &c->new);
+	text_changed(txt, pos, 0, len);
+	return new;
+}
+
+bool text_insert(Text *txt, size_t pos, const char *data, size_t len) {
+	if (len == 0)
+		return true;
+	if (pos > txt->size || txt->loading)
+		return false;
+	if (pos < txt->lines.pos)
+		lineno_cache_invalidate(&txt->lines);
+
+	Location loc = piece_get_intern(txt, pos);
+	Piece *p = loc.piece;
+	if (!p)
+		return false;
+	size_t off = loc.off;
+	if (cache_insert(txt, p, off, data, len)) {
+		text_changed(txt, pos, 0, len);
+		return true;
+	}
+
+	if (!(data = buffer_store(txt, data, len)))
+		return false;
+
+	Piece *new = piece_insert(txt, pos, loc, data, len);
+	if (!new)
+		return false;
+	cache_piece(txt, new);
 	return true;
 }
 
+bool text_insert_file(Text *txt, size_t pos, const char *filename) {
+	if (pos > txt->size || txt->loading)
+		return false;
+	int fd = open(filename, O_RDONLY);
+	if (fd == -1)
+		return false;
+	bool ret = false;
+	struct stat info;
+	Buffer *buf = NULL;
+	if (fstat(fd, &info) == -1)
+		goto out;
+	if (!S_ISREG(info.st_mode)) {
+		errno = S_ISDIR(info.st_mode) ? EISDIR : ENOTSUP;
+		goto out;
+	}
+	if (info.st_size == 0) {
+		ret = true;
+		goto out;
+	}
+	char *data = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (data == MAP_FAILED)
+		goto out;
+	if (!(buf = buffer_mapped(txt, data, info.st_size))) {
+		munmap(data, info.st_size);
+		goto out;
+	}
+
+	if (pos < txt->lines.pos)
+		lineno_cache_invalidate(&txt->lines);
+	Location loc = piece_get_intern(txt, pos);
+	ret = loc.piece && piece_insert(txt, pos, loc, buf->data, buf->len);
+out:
+	close(fd);
+	return ret;
+}
+
+ssize_t text_follow(Text *txt) {
+	struct stat info;
+	if (txt->fd == -1 || txt->loading || fstat(txt->fd, &info) == -1)
+		return -1;
+	size_t size = info.st_size, old = txt->followed;
+	if (size < old) {
+		errno = ERANGE;
+		return -1;
+	}
+	if (size == old)
+		return 0;
+	Buffer *buf = txt->follow;
+	if (!buf || size > txt->follow_off + buf->size) {
+		/* map beyond the end of file, such that further growth is covered */
+		size_t off = old - old % sysconf(_SC_PAGESIZE);
+		size_t len = MAX(size - off, FOLLOW_MAP_SIZE);
+		char *data = mmap(NULL, len, PROT_READ, MAP_SHARED, txt->fd, off);
+		if (data == MAP_FAILED)
+			return -1;
+		if (!(buf = buffer_mapped(txt, data, len))) {
+			munmap(data, len);
+			return -1;
+		}
+		txt->follow = buf;
+		txt->follow_off = off;
+	}
+	buf->len = size - txt->follow_off;
+
+	bool modified = text_modified(txt);
+	text_snapshot(txt);
+	Location loc = piece_get_intern(txt, txt->size);
+	if (!loc.piece || !piece_insert(txt, txt->size, loc, buf->data + (old - txt->follow_off), size - old))
+		return -1;
+	text_snapshot(txt);
+	txt->followed = size;
+	if (!modified) {
+		/* the text still corresponds to the file */
+		txt->saved_action = txt->undo;
+		txt->saved_info = info;
+		recovery_reset(txt);
+	}
+	return size - old;
+}
+
+/* index of the first byte in which a and b differ or len if they are equal */
+static size_t mismatch(const char *a, const char *b, size_t len) {
+	size_t i = 0;
+	while (i < len) {
+		size_t n = MIN(len - i, RELOAD_BLOCK_SIZE);
+		if (memcmp(a + i, b + i, n))
+			break;
+		i += n;
+	}
+	while (i < len && a[i] == b[i])
+		i++;
+	return i;
+}
+
+/* number of equal bytes at the end of the len bytes preceding a and b */
+static size_t mismatch_back(const char *a, const char *b, size_t len) {
+	size_t i = 0;
+	while (i < len) {
+		size_t n = MIN(len - i, RELOAD_BLOCK_SIZE);
+		if (memcmp(a - i - n, b - i - n, n))
+			break;
+		i += n;
+	}
+	while (i < len && a[-i-1] == b[-i-1])
+		i++;
+	return i;
+}
+
+bool text_reload(Text *txt) {
+	if (!txt->filename || txt->loading)
+		return false;
+	if (txt->save)
+		text_save_finish(txt);
+	int fd = open(txt->filename, O_RDONLY);
+	if (fd == -1)
+		return false;
+	bool ret = false;
+	struct stat info;
+	char *data = NULL;
+	size_t size = 0;
+	if (fstat(fd, &info) == -1)
+		goto out;
+	if (!S_ISREG(info.st_mode)) {
+		errno = S_ISDIR(info.st_mode) ? EISDIR : ENOTSUP;
+		goto out;
+	}
+	bool same = txt->fd != -1 && info.st_dev == txt->info.st_dev && info.st_ino == txt->info.st_ino;
+	if (same && (size_t)info.st_size < txt->followed) {
+		/* truncated in place, the mapped content beyond its end is gone */
+		errno = ERANGE;
+		goto out;
+	}
+	size = info.st_size;
+	if (size && (data = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+		data = NULL;
+		goto out;
+	}
+
+	/* determine the common prefix and suffix of both versions */
+	size_t prefix = 0, suffix = 0, common = MIN(size, txt->size);
+	for (Piece *p = txt->begin.next; p != &txt->end && prefix < common; p = p->next) {
+		size_t len = MIN(p->len, common - prefix);
+		size_t n = mismatch(p->data, data + prefix, len);
+		prefix += n;
+		if (n < len)
+			break;
+	}
+	for (Piece *p = txt->end.prev; p != &txt->begin && prefix + suffix < common; p = p->prev) {
+		size_t len = MIN(p->len, common - prefix - suffix);
+		size_t n = mismatch_back(p->data + p->len, data + size - suffix, len);
+		suffix += n;
+		if (n < len)
+			break;
+	}
+	/* replace whole lines, such that the undo positions are at their start */
+	while (prefix > 0 && data[prefix-1] != '\n')
+		prefix--;
+	while (suffix > 0 && suffix < size && data[size-suffix-1] != '\n')
+		suffix--;
+
+	size_t del = txt->size - prefix - suffix, ins = size - prefix - suffix;
+	text_snapshot(txt);
+	if (del && !text_delete(txt, prefix, del))
+		goto out;
+	if (ins > RELOAD_COPY_MAX) {
+		/* refer to the file content instead of copying it */
+		Buffer *buf = buffer_mapped(txt, data, size);
+		if (!buf)
+			goto out;
+		data = NULL;
+		if (prefix < txt->lines.pos)
+			lineno_cache_invalidate(&txt->lines);
+		Location loc = piece_get_intern(txt, prefix);
+		if (!loc.piece || !piece_insert(txt, prefix, loc, buf->data + prefix, ins))
+			goto out;
+	} else if (ins && !text_insert(txt, prefix, data + prefix, ins)) {
+		goto out;
+	}
+	text_snapshot(txt);
+
+	/* the text corresponds to the file again */
+	txt->saved_action = txt->undo;
+	txt->saved_info = info;
+	if (same)
+		txt->followed = size;
+	recovery_reset(txt);
+	ret = true;
+out:
+	if (data)
+		munmap(data, size);
+	close(fd);
+	return ret;
+}
+
+bool text_file_changed(Text *txt) {
+	struct stat info;
+	if (!txt->filename || txt->loading || stat(txt->filename, &info) == -1)
+		return false;
+	return !stat_same(&info, &txt->saved_info);
+}
+
+bool text_file_same(Text *txt, const char *filename) {
+	struct stat info;
+	if (!txt->filename || stat(filename, &info) == -1)
+		return false;
+	return info.st_dev == txt->saved_info.st_dev && info.st_ino == txt->saved_info.st_ino;
+}
+
 size_t text_undo(Text *txt) {
 	size_t pos = EPOS;
+	history_restore(txt);
 	/* taking a snapshot makes sure that txt->current_action is reset */
 	text_snapshot(txt);
 	Action *a = action_pop(&txt->undo);
@@ -566,6 +1166,11 @@ size_t text_undo(Text *txt) {
 		return pos;
 	for (Change *c = a->change; c; c = c->next) {
 		span_swap(txt, &c->new, &c->old);
+		/* every change is either an insertion or a deletion at c->pos */
+		if (c->new.len > c->old.len)
+			text_changed(txt, c->pos, c->new.len - c->old.len, 0);
+		else
+			text_changed(txt, c->pos, 0, c->old.len - c->new.len);
 		pos = c->pos;
 	}
 
@@ -576,36 +1181,200 @@ size_t text_undo(Text *txt) {
 
 size_t text_redo(Text *txt) {
 	size_t pos = EPOS;
+	history_restore(txt);
 	Action *a = action_pop(&txt->redo);
 	if (!a)
 		return pos;
+	/* changes are stored most recent first, but have to be
+	 * reapplied in the order in which they were performed */
+	action_reverse(a);
 	for (Change *c = a->change; c; c = c->next) {
 		span_swap(txt, &c->old, &c->new);
-		pos = c->pos;
+		if (c->new.len > c->old.len)
+			text_changed(txt, c->pos, 0, c->new.len - c->old.len);
+		else
+			text_changed(txt, c->pos, c->old.len - c->new.len, 0);
+		if (pos == EPOS)
+			pos = c->pos;
 	}
+	action_reverse(a);
 
 	action_push(&txt->undo, a);
 	lineno_cache_invalidate(&txt->lines);
 	return pos;
 }
 
+size_t text_revert(Text *txt) {
+	Action *a = txt->current_action;
+	if (!a)
+		return EPOS;
+	size_t pos = text_undo(txt);
+	if (txt->redo == a)
+		action_free(action_pop(&txt->redo));
+	return pos;
+}
+
 bool text_save(Text *txt, const char *filename) {
 	Filerange r = (Filerange){ .start = 0, .end = text_size(txt) };
 	return text_range_save(txt, &r, filename);
 }
 
-/* save current content to given filename. the data is first saved to `filename~`
- * and then atomically moved to its final (possibly alredy existing) destination
- * using rename(2).
- */
-bool text_range_save(Text *txt, Filerange *range, const char *filename) {
-	int fd = -1;
+/* whether [off, off+len) of the original file content still matches the file on disk */
+static bool buf_current(Text *txt, size_t off, size_t len) {
+	return off + len <= txt->stale.start || off >= txt->stale.end;
+}
+
+/* write all iovcnt elements of iov to fd, handling partial writes */
+static bool write_iov(int fd, struct iovec *iov, int iovcnt) {
+	while (iovcnt > 0) {
+		ssize_t res = writev(fd, iov, iovcnt);
+		if (res < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		for (; iovcnt > 0 && (size_t)res >= iov->iov_len; iov++, iovcnt--)
+			res -= iov->iov_len;
+		if (iovcnt > 0) {
+			iov->iov_base = (char*)iov->iov_base + res;
+			iov->iov_len -= res;
+		}
+	}
+	return true;
+}
+
+/* copy len bytes starting at off of the original file to the current position
+ * of fd within the kernel. returns the number of bytes copied which is less than
+ * len if the file systems involved do not support it. */
+static size_t copy_original(Text *txt, size_t off, int fd, size_t len) {
+	size_t done = 0;
+#if HAVE_COPY_FILE_RANGE
+	loff_t off_in = off;
+	while (done < len) {
+		ssize_t res = copy_file_range(txt->fd, &off_in, fd, NULL, len - done, 0);
+		if (res < 0 && errno == EINTR)
+			continue;
+		if (res <= 0)
+			break;
+		done += res;
+	}
+#endif
+	return done;
+}
+
+/* collect the (data, len) pairs of all pieces forming the range. as long as no
+ * further modification happens after a snapshot, the referenced data is never
+ * changed and the result can be used to write a consistent state of the text */
+static struct iovec *text_range_pieces(Text *txt, Filerange *range, size_t *count) {
+	size_t size = 1, rem = text_range_size(range);
+	struct iovec *pieces = malloc(size * sizeof *pieces);
+	*count = 0;
+	for (Iterator it = text_iterator_get(txt, range->start);
+	     pieces && rem > 0 && text_iterator_valid(&it);
+	     text_iterator_next(&it)) {
+		size_t len = MIN((size_t)(it.end - it.text), rem);
+		if (len == 0)
+			continue;
+		if (*count == size) {
+			struct iovec *p = realloc(pieces, 2 * size * sizeof *pieces);
+			if (!p) {
+				free(pieces);
+				return NULL;
+			}
+			pieces = p;
+			size *= 2;
+		}
+		pieces[(*count)++] = (struct iovec){ .iov_base = (char*)it.text, .iov_len = len };
+		rem -= len;
+	}
+	return pieces;
+}
+
+/* write the pieces to fd. data of the original file is copied within the kernel
+ * if possible, all other pieces are written in batches using writev(2). */
+static bool pieces_write_all(Text *txt, struct iovec *pieces, size_t count, int fd,
+                             bool (*progress)(Text*, size_t done, size_t total)) {
+	struct iovec iov[WRITEV_BATCH];
+	int iovcnt = 0;
+	size_t size = 0, rem, pending = 0;
+	bool copy = HAVE_COPY_FILE_RANGE && txt->buf.data;
+
+	for (size_t i = 0; i < count; i++)
+		size += pieces[i].iov_len;
+	rem = size;
+
+	for (size_t i = 0; i < count; i++) {
+		const char *data = pieces[i].iov_base;
+		size_t len = pieces[i].iov_len;
+		if (copy && txt->buf.data <= data && data < txt->buf.data + txt->buf.size &&
+		    buf_current(txt, data - txt->buf.data, len)) {
+			if (!write_iov(fd, iov, iovcnt))
+				return false;
+			iovcnt = pending = 0;
+			while (len > 0) {
+				size_t chunk = MIN(len, PROGRESS_INTERVAL);
+				size_t copied = copy_original(txt, data - txt->buf.data, fd, chunk);
+				data += copied;
+				len -= copied;
+				rem -= copied;
+				if (!progress(txt, size - rem, size))
+					return false;
+				if (copied < chunk) {
+					/* not supported, write the remaining data instead */
+					copy = false;
+					break;
+				}
+			}
+		}
+		while (len > 0) {
+			size_t chunk = MIN(len, PROGRESS_INTERVAL);
+			iov[iovcnt++] = (struct iovec){ .iov_base = (char*)data, .iov_len = chunk };
+			data += chunk;
+			len -= chunk;
+			rem -= chunk;
+			pending += chunk;
+			if (iovcnt == WRITEV_BATCH || pending >= PROGRESS_INTERVAL) {
+				if (!write_iov(fd, iov, iovcnt) || !progress(txt, size - rem, size))
+					return false;
+				iovcnt = pending = 0;
+			}
+		}
+	}
+
+	return write_iov(fd, iov, iovcnt);
+}
+
+/* advise on the data of the pieces, this walks the buffers of the text and
+ * must therefore not be called by the thread of a background save */
+static void pieces_advise(Text *txt, struct iovec *pieces, size_t count, enum TextAdvice advice) {
+	for (size_t i = 0; i < count; i++)
+		buffer_advise(txt, pieces[i].iov_base, pieces[i].iov_len, advice);
+}
+
+/* like pieces_write_all, the file content is meanwhile read sequentially */
+static bool pieces_write(Text *txt, struct iovec *pieces, size_t count, int fd,
+                         bool (*progress)(Text*, size_t done, size_t total)) {
+	pieces_advise(txt, pieces, count, TEXT_ADVICE_SEQUENTIAL);
+	bool ret = pieces_write_all(txt, pieces, count, fd, progress);
+	pieces_advise(txt, pieces, count, TEXT_ADVICE_NORMAL);
+	return ret;
+}
+
+static bool text_range_write_all(Text *txt, Filerange *range, int fd) {
+	size_t count;
+	struct iovec *pieces = text_range_pieces(txt, range, &count);
+	bool ret = pieces && pieces_write(txt, pieces, count, fd, text_progress);
+	free(pieces);
+	return ret;
+}
+
+/* create the temporary file `filename~` with the permissions of filename,
+ * returns its file descriptor and stores its (malloc-ed) name in tmpname */
+static int save_begin(const char *filename, char **tmpname) {
 	size_t bufsize = strlen(filename) + 10;
-	size_t size = text_range_size(range);
-	char *tmpname = malloc(bufsize);
-	if (!tmpname)
-		return false;
-	snprintf(tmpname, bufsize, "%s~", filename);
+	if (!(*tmpname = malloc(bufsize)))
+		return -1;
+	snprintf(*tmpname, bufsize, "%s~", filename);
 	// TODO preserve user/group
 	struct stat meta;
 	if (stat(filename, &meta) == -1) {
@@ -614,53 +1383,722 @@ bool text_range_save(Text *txt, Filerange *range, const char *filename) {
 		else
 			goto err;
 	}
-	/* O_RDWR is needed because otherwise we can't map with MAP_SHARED */
-	if ((fd = open(tmpname, O_CREAT|O_RDWR|O_TRUNC, meta.st_mode)) == -1)
-		goto err;
-	if (ftruncate(fd, size) == -1)
-		goto err;
-	if (size > 0) {
-		void *buf = mmap(NULL, size, PROT_WRITE, MAP_SHARED, fd, 0);
-		if (buf == MAP_FAILED)
-			goto err;
-
-		char *cur = buf;
-		size_t rem = size;
-
-		for (Iterator it = text_iterator_get(txt, range->start);
-		     rem > 0 && text_iterator_valid(&it);
-		     text_iterator_next(&it)) {
-			size_t len = it.end - it.text;
-			if (len > rem)
-				len = rem;
-			memcpy(cur, it.text, len);
-			cur += len;
-			rem -= len;
-		}
+	int fd = open(*tmpname, O_CREAT|O_WRONLY|O_TRUNC, meta.st_mode);
+	if (fd != -1)
+		return fd;
+err:
+	free(*tmpname);
+	*tmpname = NULL;
+	return -1;
+}
 
-		if (munmap(buf, size) == -1)
-			goto err;
-	}
+/* close the temporary file and, if it was written successfully, atomically
+ * move it to its final destination. otherwise it is removed. */
+static bool save_commit(bool success, int fd, char *tmpname, const char *filename) {
 	if (close(fd) == -1)
-		goto err;
-	fd = -1;
-	if (rename(tmpname, filename) == -1)
-		goto err;
+		success = false;
+	if (success && rename(tmpname, filename) == -1)
+		success = false;
+	if (!success) {
+		int error = errno;
+		unlink(tmpname);
+		errno = error;
+	}
+	free(tmpname);
+	return success;
+}
+
+/* the content of filename now corresponds to the saved action */
+static void text_saved(Text *txt, const char *filename) {
+	if (!txt->filename || strcmp(txt->filename, filename))
+		return;
+	/* a persisted history refers to the previous file content */
+	history_restore(txt);
+	history_remove(txt);
+	stat(filename, &txt->saved_info);
+	recovery_reset(txt);
+	/* the file was rewritten as a whole, the original content no longer applies */
+	text_journal_discard(txt);
+}
+
+/* save current content to given filename. the data is first saved to `filename~`
+ * and then atomically moved to its final (possibly alredy existing) destination
+ * using rename(2).
+ */
+bool text_range_save(Text *txt, Filerange *range, const char *filename) {
+	char *tmpname;
+	if (txt->save)
+		text_save_finish(txt);
+	int fd = save_begin(filename, &tmpname);
+	if (fd == -1)
+		return false;
+	if (!save_commit(text_range_write_all(txt, range, fd), fd, tmpname, filename))
+		return false;
 	txt->saved_action = txt->undo;
 	text_snapshot(txt);
 	if (!txt->filename)
 		text_filename_set(txt, filename);
-	free(tmpname);
+	if (range->start == 0 && range->end == txt->size)
+		text_saved(txt, filename);
 	return true;
-err:
-	if (fd != -1)
-		close(fd);
-	free(tmpname);
-	return false;
 }
 
-ssize_t text_write(Text *txt, int fd) {
-	Filerange r = (Filerange){ .start = 0, .end = text_size(txt) };
+/* updates the progress of a background save, called from the saving thread */
+static bool save_progress(Text *txt, size_t done, size_t total) {
+	Save *save = txt->save;
+	pthread_mutex_lock(&save->lock);
+	save->done = done;
+	pthread_mutex_unlock(&save->lock);
+	return true;
+}
+
+static void *save_thread(void *arg) {
+	Save *save = arg;
+	/* the access pattern is advised by the main thread, see text_range_save_start */
+	bool success = pieces_write_all(save->text, save->pieces, save->count, save->fd, save_progress);
+	save->success = save_commit(success, save->fd, save->tmpname, save->filename);
+	save->error = errno;
+	save->tmpname = NULL;
+	save->fd = -1;
+	while (write(save->pipe[1], "", 1) == -1 && errno == EINTR);
+	return NULL;
+}
+
+static void save_free(Save *save) {
+	if (!save)
+		return;
+	if (save->fd != -1) {
+		close(save->fd);
+		unlink(save->tmpname);
+	}
+	for (int i = 0; i < 2; i++) {
+		if (save->pipe[i] != -1)
+			close(save->pipe[i]);
+	}
+	free(save->tmpname);
+	free(save->filename);
+	free(save->pieces);
+	free(save);
+}
+
+bool text_range_save_start(Text *txt, Filerange *range, const char *filename) {
+	if (txt->save) {
+		errno = EBUSY;
+		return false;
+	}
+	Save *save = calloc(1, sizeof *save);
+	if (!save)
+		return false;
+	save->text = txt;
+	save->fd = save->pipe[0] = save->pipe[1] = -1;
+	/* after a snapshot the data of all existing pieces is immutable */
+	text_snapshot(txt);
+	save->action = txt->undo;
+	save->whole = range->start == 0 && range->end == txt->size;
+	if (!(save->filename = strdup(filename)) ||
+	    !(save->pieces = text_range_pieces(txt, range, &save->count)) ||
+	    pipe(save->pipe) == -1 ||
+	    (save->fd = save_begin(filename, &save->tmpname)) == -1)
+		goto err;
+	for (size_t i = 0; i < save->count; i++)
+		save->size += save->pieces[i].iov_len;
+	pieces_advise(txt, save->pieces, save->count, TEXT_ADVICE_SEQUENTIAL);
+	pthread_mutex_init(&save->lock, NULL);
+	txt->save = save;
+	/* signals are handled by the main thread */
+	sigset_t all, old;
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	int error = pthread_create(&save->thread, NULL, save_thread, save);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	if (error) {
+		pthread_mutex_destroy(&save->lock);
+		txt->save = NULL;
+		errno = error;
+		goto err;
+	}
+	return true;
+err:
+	save_free(save);
+	return false;
+}
+
+int text_save_fd(Text *txt) {
+	return txt->save ? txt->save->pipe[0] : -1;
+}
+
+bool text_save_progress(Text *txt, size_t *done, size_t *total) {
+	Save *save = txt->save;
+	if (!save)
+		return false;
+	pthread_mutex_lock(&save->lock);
+	*done = save->done;
+	pthread_mutex_unlock(&save->lock);
+	*total = save->size;
+	return true;
+}
+
+bool text_save_finish(Text *txt) {
+	Save *save = txt->save;
+	if (!save)
+		return true;
+	pthread_join(save->thread, NULL);
+	pthread_mutex_destroy(&save->lock);
+	pieces_advise(txt, save->pieces, save->count, TEXT_ADVICE_NORMAL);
+	txt->save = NULL;
+	bool success = save->success;
+	if (success) {
+		txt->saved_action = save->action;
+		if (!txt->filename)
+			text_filename_set(txt, save->filename);
+		if (save->whole)
+			text_saved(txt, save->filename);
+	}
+	int error = save->error;
+	save_free(save);
+	if (!success)
+		errno = error;
+	return success;
+}
+
+/* An in-place save first stores the original content of the region which is
+ * about to be overwritten in a journal `filename~journal`. The header is only
+ * written once the data is durable, hence a journal with a valid header means
+ * that the file might be inconsistent and has to be restored from it.
+ */
+#define JOURNAL_MAGIC "visjrnl1"
+
+typedef struct {
+	char magic[8];          /* JOURNAL_MAGIC once the data has been synced */
+	uint64_t offset;        /* file offset of the saved original content */
+	uint64_t len;           /* length of the saved original content */
+	uint64_t data;          /* offset of the saved content within the journal */
+	uint64_t size;          /* original file size */
+} JournalHeader;
+
+static char *journal_name(const char *filename) {
+	size_t len = strlen(filename) + sizeof "~journal";
+	char *name = malloc(len);
+	if (name)
+		snprintf(name, len, "%s~journal", filename);
+	return name;
+}
+
+/* make a created or removed directory entry of filename durable */
+static void journal_sync_dir(const char *filename) {
+	char *dir = strdup(filename);
+	if (!dir)
+		return;
+	char *slash = strrchr(dir, '/');
+	if (slash)
+		*(slash == dir ? slash + 1 : slash) = '\0';
+	int fd = open(slash ? dir : ".", O_RDONLY);
+	if (fd != -1) {
+		fsync(fd);
+		close(fd);
+	}
+	free(dir);
+}
+
+static bool pwrite_all(int fd, const char *data, size_t len, size_t off) {
+	while (len > 0) {
+		ssize_t res = pwrite(fd, data, len, off);
+		if (res < 0 && errno == EINTR)
+			continue;
+		if (res <= 0)
+			return false;
+		data += res;
+		len -= res;
+		off += res;
+	}
+	return true;
+}
+
+/* write the original content saved in the journal back to fd */
+static bool journal_restore(int fd, JournalHeader *hdr, const char *data) {
+	return pwrite_all(fd, data, hdr->len, hdr->offset) &&
+	       ftruncate(fd, hdr->size) == 0 && fsync(fd) == 0;
+}
+
+/* whether an in-place save of filename did not complete and its journal has to be
+ * restored. a journal without a valid header is removed, the file was never modified */
+static bool journal_check(const char *filename) {
+	char *name = journal_name(filename);
+	if (!name)
+		return false;
+	int jfd = open(name, O_RDONLY);
+	if (jfd == -1) {
+		free(name);
+		return false;
+	}
+	JournalHeader hdr;
+	bool valid = read(jfd, &hdr, sizeof hdr) == sizeof hdr &&
+	             !memcmp(hdr.magic, JOURNAL_MAGIC, sizeof hdr.magic);
+	if (!valid) {
+		unlink(name);
+		journal_sync_dir(filename);
+	}
+	close(jfd);
+	free(name);
+	return valid;
+}
+
+bool text_journal_available(Text *txt) {
+	return txt->journal;
+}
+
+bool text_journal_restore(Text *txt) {
+	if (!txt->journal || !txt->filename) {
+		errno = ENOENT;
+		return false;
+	}
+	if (txt->loading || text_modified(txt)) {
+		errno = EBUSY;
+		return false;
+	}
+	char *name = journal_name(txt->filename);
+	if (!name)
+		return false;
+	int jfd = open(name, O_RDONLY), fd = -1;
+	char *data = NULL;
+	bool ret = false;
+	JournalHeader hdr;
+	struct stat info;
+	if (jfd == -1)
+		goto out;
+	if (read(jfd, &hdr, sizeof hdr) != sizeof hdr ||
+	    memcmp(hdr.magic, JOURNAL_MAGIC, sizeof hdr.magic) ||
+	    fstat(jfd, &info) == -1 || hdr.data + hdr.len > (uint64_t)info.st_size) {
+		errno = EINVAL;
+		goto out;
+	}
+	if (hdr.len && (data = mmap(NULL, hdr.data + hdr.len, PROT_READ, MAP_PRIVATE, jfd, 0)) == MAP_FAILED) {
+		data = NULL;
+		goto out;
+	}
+	if ((fd = open(txt->filename, O_WRONLY)) == -1 ||
+	    !journal_restore(fd, &hdr, data ? data + hdr.data : NULL))
+		goto out;
+	unlink(name);
+	journal_sync_dir(txt->filename);
+	txt->journal = false;
+	ret = true;
+out:
+	if (data)
+		munmap(data, hdr.data + hdr.len);
+	if (fd != -1)
+		close(fd);
+	if (jfd != -1)
+		close(jfd);
+	free(name);
+	return ret;
+}
+
+void text_journal_discard(Text *txt) {
+	char *name = txt->journal && txt->filename ? journal_name(txt->filename) : NULL;
+	if (name && unlink(name) == 0) {
+		journal_sync_dir(txt->filename);
+		txt->journal = false;
+	}
+	free(name);
+}
+
+/* Determine the modified region [start, end) of the text compared to the
+ * file on disk by skipping the pieces at the beginning (and, if the size is
+ * unchanged, at the end) which still refer to the original file content at
+ * its original offset.
+ */
+static Filerange text_modified_range(Text *txt) {
+	const char *data = txt->buf.data;
+	Filerange r = { .start = 0, .end = txt->size };
+	for (Piece *p = txt->begin.next; p != &txt->end; p = p->next) {
+		if (p->data != data + r.start)
+			break;
+		if (!buf_current(txt, r.start, p->len)) {
+			/* the piece might still match up to the stale region */
+			r.start = MAX(r.start, MIN(txt->stale.start, r.start + p->len));
+			break;
+		}
+		r.start += p->len;
+	}
+	if (txt->size != txt->buf.size || r.start == txt->size)
+		return r;
+	for (Piece *p = txt->end.prev; p != &txt->begin; p = p->prev) {
+		if (p->data != data + r.end - p->len)
+			break;
+		if (!buf_current(txt, r.end - p->len, p->len)) {
+			if (txt->stale.end < r.end)
+				r.end = MAX(txt->stale.end, r.end - p->len);
+			break;
+		}
+		r.end -= p->len;
+	}
+	return r;
+}
+
+bool text_save_inplace(Text *txt, const char *filename) {
+	struct stat info;
+	if (txt->save)
+		text_save_finish(txt);
+	if (!txt->buf.data || !txt->filename || strcmp(txt->filename, filename) || txt->journal ||
+	    stat(filename, &info) == -1 || info.st_dev != txt->info.st_dev ||
+	    info.st_ino != txt->info.st_ino || info.st_size != txt->info.st_size ||
+	    info.st_mtime != txt->info.st_mtime)
+		return text_save(txt, filename);
+
+	/* the original content of all affected pages is saved, such that it can
+	 * be mapped in place of the overwritten file content */
+	size_t pagesize = sysconf(_SC_PAGESIZE);
+	size_t size = info.st_size;
+	Filerange mod = text_modified_range(txt);
+	if (mod.start == mod.end && txt->size == size)
+		goto saved;
+	size_t start = MIN(mod.start, size), end = size;
+	start -= start % pagesize;
+	if (txt->size == size)
+		end = MIN(mod.end + pagesize - 1 - (mod.end + pagesize - 1) % pagesize, size);
+	if ((end - start) + (mod.end - mod.start) > size / 2)
+		return text_save(txt, filename);
+
+	int fd = -1, jfd = -1;
+	char *jname = journal_name(filename);
+	JournalHeader hdr = {
+		.offset = start,
+		.len = end - start,
+		.data = pagesize,
+		.size = size,
+	};
+	if (!jname)
+		goto err;
+	if ((fd = open(filename, O_WRONLY)) == -1)
+		goto err;
+	if ((jfd = open(jname, O_CREAT|O_EXCL|O_RDWR, S_IRUSR|S_IWUSR)) == -1)
+		goto err;
+	if (!pwrite_all(jfd, txt->buf.data + start, end - start, hdr.data) || fsync(jfd) == -1)
+		goto err_journal;
+	memcpy(hdr.magic, JOURNAL_MAGIC, sizeof hdr.magic);
+	if (!pwrite_all(jfd, (char*)&hdr, sizeof hdr, 0) || fsync(jfd) == -1)
+		goto err_journal;
+	journal_sync_dir(filename);
+
+	/* pieces referring to the overwritten region now read the journal */
+	if (start < txt->buf.size && mmap(txt->buf.data + start, MIN(end, txt->buf.size) - start,
+	    PROT_READ, MAP_PRIVATE|MAP_FIXED, jfd, hdr.data) == MAP_FAILED)
+		goto err_journal;
+	Filerange stale = { .start = start, .end = txt->size == size ? end : EPOS };
+	if (txt->stale.start != EPOS) {
+		stale.start = MIN(stale.start, txt->stale.start);
+		stale.end = MAX(stale.end, txt->stale.end);
+	}
+	txt->stale = stale;
+
+	if (lseek(fd, mod.start, SEEK_SET) == -1 || !text_range_write_all(txt, &mod, fd) ||
+	    (txt->size < size && ftruncate(fd, txt->size) == -1) || fsync(fd) == -1) {
+		if (journal_restore(fd, &hdr, txt->buf.data + start))
+			goto err_journal;
+		/* keep the journal, it is reported upon the next load */
+		goto err;
+	}
+
+	unlink(jname);
+	journal_sync_dir(filename);
+	fstat(fd, &txt->info);
+	close(jfd);
+	close(fd);
+	free(jname);
+saved:
+	txt->saved_action = txt->undo;
+	text_snapshot(txt);
+	text_saved(txt, filename);
+	return true;
+err_journal:
+	unlink(jname);
+err:
+	if (jfd != -1)
+		close(jfd);
+	if (fd != -1)
+		close(fd);
+	free(jname);
+	return false;
+}
+
+/* the journal of modifications of filename since it was last saved, or the
+ * separate one used while the former is kept for a later recovery */
+static char *recovery_name(const char *filename, bool separate) {
+	size_t len = strlen(filename) + sizeof "~recover.new";
+	char *name = malloc(len);
+	if (name)
+		snprintf(name, len, separate ? "%s~recover.new" : "%s~recover", filename);
+	return name;
+}
+
+/* remove the journal the modifications of this session are recorded in */
+static void recovery_remove(Text *txt) {
+	char *name = recovery_name(txt->filename, txt->recovery.previous);
+	if (name)
+		unlink(name);
+	free(name);
+}
+
+static RecoveryHeader *recovery_map(Text *txt, int fd, size_t *size);
+
+/* look once for a non-empty journal of a previous session which applies to
+ * the file as loaded, it is kept until it is recovered or discarded */
+static void recovery_check(Text *txt) {
+	Recovery *r = &txt->recovery;
+	size_t size;
+	char *name;
+	if (r->checked || !txt->filename || !(name = recovery_name(txt->filename, false)))
+		return;
+	r->checked = true;
+	int fd = open(name, O_RDONLY);
+	free(name);
+	if (fd == -1)
+		return;
+	RecoveryHeader *hdr = recovery_map(txt, fd, &size);
+	close(fd);
+	if (!hdr)
+		return;
+	munmap(hdr, size);
+	r->previous = size > sizeof *hdr;
+}
+
+static bool recovery_append(Recovery *r, const void *data, size_t len) {
+	if (r->size - r->len < len) {
+		size_t size = MAX(2 * r->size, r->len + len);
+		char *p = realloc(r->data, size);
+		if (!p)
+			return false;
+		r->data = p;
+		r->size = size;
+	}
+	if (data)
+		memcpy(r->data + r->len, data, len);
+	r->len += len;
+	return true;
+}
+
+/* write all pending records, this is also triggered once enough accumulated */
+bool text_recovery_flush(Text *txt) {
+	Recovery *r = &txt->recovery;
+	if (r->fd == -1 || r->len == 0)
+		return true;
+	struct iovec iov = { .iov_base = r->data, .iov_len = r->len };
+	r->len = 0;
+	return write_iov(r->fd, &iov, 1);
+}
+
+/* start a new journal for the file content as of the last save */
+static bool recovery_open(Text *txt) {
+	Recovery *r = &txt->recovery;
+	recovery_check(txt);
+	char *name = recovery_name(txt->filename, r->previous);
+	if (!name)
+		return false;
+	r->fd = open(name, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, S_IRUSR|S_IWUSR);
+	free(name);
+	if (r->fd == -1)
+		return false;
+	RecoveryHeader hdr = {
+		.magic = RECOVERY_MAGIC,
+		.size = txt->saved_info.st_size,
+		.mtime = txt->saved_info.st_mtime,
+		.mtime_nsec = MTIME_NSEC(&txt->saved_info),
+	};
+	r->len = 0;
+	return recovery_append(r, &hdr, sizeof hdr);
+}
+
+/* record the replacement of deleted bytes at pos by the inserted ones, which
+ * are by now part of the text */
+static void recovery_record(Text *txt, size_t pos, size_t deleted, size_t inserted) {
+	Recovery *r = &txt->recovery;
+	if (!r->enabled || !txt->filename || txt->loading)
+		return;
+	RecoveryRecord rec = { .pos = pos, .deleted = deleted, .inserted = inserted };
+	bool ok = r->fd != -1 || recovery_open(txt);
+	if (ok && inserted > RECOVERY_BUFFER) {
+		/* large insertions are written directly instead of being copied */
+		Filerange range = { .start = pos, .end = pos + inserted };
+		ok = recovery_append(r, &rec, sizeof rec) && text_recovery_flush(txt) &&
+		     text_range_write_all(txt, &range, r->fd);
+	} else if (ok && recovery_append(r, &rec, sizeof rec) && recovery_append(r, NULL, inserted)) {
+		text_bytes_get(txt, pos, inserted, r->data + r->len - inserted);
+		if (r->len >= RECOVERY_BUFFER)
+			ok = text_recovery_flush(txt);
+	} else {
+		ok = false;
+	}
+	if (!ok) {
+		/* an incomplete journal is useless */
+		r->enabled = false;
+		if (r->fd != -1) {
+			close(r->fd);
+			r->fd = -1;
+			recovery_remove(txt);
+		}
+	}
+}
+
+/* the text was saved to its file, the journal starts anew */
+static void recovery_reset(Text *txt) {
+	Recovery *r = &txt->recovery;
+	if (r->fd != -1) {
+		close(r->fd);
+		recovery_remove(txt);
+	}
+	r->fd = -1;
+	r->len = 0;
+	/* modifications made during a background save are recorded as one */
+	if (text_modified(txt))
+		recovery_record(txt, 0, txt->saved_info.st_size, txt->size);
+}
+
+void text_recovery_set(Text *txt, bool enable) {
+	Recovery *r = &txt->recovery;
+	if (!enable && r->fd != -1) {
+		close(r->fd);
+		r->fd = -1;
+		recovery_remove(txt);
+	}
+	r->enabled = enable;
+}
+
+void text_recovery_keep(Text *txt) {
+	Recovery *r = &txt->recovery;
+	text_recovery_flush(txt);
+	if (r->fd != -1)
+		close(r->fd);
+	r->fd = -1;
+	r->enabled = false;
+}
+
+bool text_recovery_pending(Text *txt) {
+	return txt->recovery.len > 0;
+}
+
+/* map the journal of the text and check whether it applies to the file as loaded */
+static RecoveryHeader *recovery_map(Text *txt, int fd, size_t *size) {
+	struct stat info;
+	if (fstat(fd, &info) == -1 || (size_t)info.st_size < sizeof(RecoveryHeader))
+		return NULL;
+	RecoveryHeader *hdr = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (hdr == MAP_FAILED)
+		return NULL;
+	*size = info.st_size;
+	if (memcmp(hdr->magic, RECOVERY_MAGIC, sizeof hdr->magic) ||
+	    hdr->size != (uint64_t)txt->saved_info.st_size ||
+	    hdr->mtime != txt->saved_info.st_mtime ||
+	    hdr->mtime_nsec != MTIME_NSEC(&txt->saved_info)) {
+		munmap(hdr, *size);
+		return NULL;
+	}
+	return hdr;
+}
+
+bool text_recovery_available(Text *txt) {
+	size_t size;
+	char *name;
+	recovery_check(txt);
+	if (!txt->recovery.previous || !(name = recovery_name(txt->filename, false)))
+		return false;
+	int fd = open(name, O_RDONLY);
+	free(name);
+	if (fd == -1)
+		return false;
+	RecoveryHeader *hdr = recovery_map(txt, fd, &size);
+	close(fd);
+	if (!hdr)
+		return false;
+	munmap(hdr, size);
+	return size > sizeof *hdr;
+}
+
+bool text_recover(Text *txt) {
+	Recovery *r = &txt->recovery;
+	size_t size;
+	char *name;
+	if (!txt->filename || txt->loading || text_modified(txt)) {
+		errno = EBUSY;
+		return false;
+	}
+	recovery_check(txt);
+	if (!r->previous) {
+		errno = ENOENT;
+		return false;
+	}
+	if (!(name = recovery_name(txt->filename, false)))
+		return false;
+	int fd = open(name, O_RDWR|O_CLOEXEC);
+	free(name);
+	if (fd == -1)
+		return false;
+	RecoveryHeader *hdr = recovery_map(txt, fd, &size);
+	if (!hdr) {
+		close(fd);
+		errno = EINVAL;
+		return false;
+	}
+
+	/* replay all complete records as one action, without recording them again */
+	bool enabled = r->enabled;
+	r->enabled = false;
+	text_snapshot(txt);
+	const char *data = (const char*)hdr, *cur = data + sizeof *hdr, *end = data + size;
+	while ((size_t)(end - cur) >= sizeof(RecoveryRecord)) {
+		RecoveryRecord rec;
+		memcpy(&rec, cur, sizeof rec);
+		if (rec.inserted > (size_t)(end - cur) - sizeof rec ||
+		    rec.pos > txt->size || rec.deleted > txt->size - rec.pos)
+			break;
+		cur += sizeof rec;
+		if (!text_delete(txt, rec.pos, rec.deleted) || !text_insert(txt, rec.pos, cur, rec.inserted))
+			break;
+		cur += rec.inserted;
+	}
+	text_snapshot(txt);
+	r->enabled = enabled;
+	size = cur - data;
+	munmap(hdr, end - data);
+
+	/* the separate journal of this session is obsolete since the text was unmodified,
+	 * the recovered one is continued after the last record which was replayed */
+	if (r->fd != -1) {
+		close(r->fd);
+		recovery_remove(txt);
+	}
+	r->previous = false;
+	r->len = 0;
+	if (enabled && ftruncate(fd, size) == 0 && lseek(fd, size, SEEK_SET) != -1) {
+		r->fd = fd;
+	} else {
+		r->fd = -1;
+		close(fd);
+	}
+	return true;
+}
+
+void text_recovery_discard(Text *txt) {
+	Recovery *r = &txt->recovery;
+	char *name, *separate;
+	recovery_check(txt);
+	if (!r->previous || !(name = recovery_name(txt->filename, false)))
+		return;
+	if (!(separate = recovery_name(txt->filename, true))) {
+		free(name);
+		return;
+	}
+	/* the journal of this session takes its place */
+	if (r->fd != -1 && rename(separate, name) == 0)
+		r->previous = false;
+	else if (unlink(name) == 0 && r->fd == -1)
+		r->previous = false;
+	free(name);
+	free(separate);
+}
+
+ssize_t text_write(Text *txt, int fd) {
+	Filerange r = (Filerange){ .start = 0, .end = text_size(txt) };
 	return text_range_write(txt, &r, fd);
 }
 
@@ -673,7 +2111,11 @@ ssize_t text_range_write(Text *txt, Filerange *range, int fd) {
 		if (prem > rem)
 			prem = rem;
 		while (prem > 0) {
-			ssize_t res = write(fd, it.text + poff, prem);
+			if (size > PROGRESS_INTERVAL && !text_progress(txt, size - rem, size)) {
+				errno = ECANCELED;
+				return -1;
+			}
+			ssize_t res = write(fd, it.text + poff, MIN(prem, PROGRESS_INTERVAL));
 			if (res < 0) {
 				if (errno == EAGAIN || errno == EINTR)
 					continue;
@@ -699,6 +2141,8 @@ Text *text_load(const char *filename) {
 	if (!txt)
 		return NULL;
 	txt->fd = -1;
+	txt->recovery.fd = -1;
+	txt->stale = text_range_empty();
 	txt->begin.index = 1;
 	txt->end.index = 2;
 	txt->piece_count = 2;
@@ -707,6 +2151,7 @@ Text *text_load(const char *filename) {
 	lineno_cache_invalidate(&txt->lines);
 	if (filename) {
 		text_filename_set(txt, filename);
+		txt->journal = journal_check(filename);
 		txt->fd = open(filename, O_RDONLY);
 		if (txt->fd == -1)
 			goto out;
@@ -716,6 +2161,7 @@ Text *text_load(const char *filename) {
 			errno = S_ISDIR(txt->info.st_mode) ? EISDIR : ENOTSUP;
 			goto out;
 		}
+		txt->saved_info = txt->info;
 		// XXX: use lseek(fd, 0, SEEK_END); instead?
 		txt->buf.size = txt->info.st_size;
 		if (txt->buf.size != 0) {
@@ -730,7 +2176,7 @@ Text *text_load(const char *filename) {
 		piece_init(&txt->begin, NULL, p, NULL, 0);
 		piece_init(p, &txt->begin, &txt->end, txt->buf.data, txt->buf.size);
 		piece_init(&txt->end, p, NULL, NULL, 0);
-		txt->size = txt->buf.size;
+		txt->size = txt->followed = txt->buf.size;
 	}
 	return txt;
 out:
@@ -746,15 +2192,56 @@ Text *text_load_fd(int fd) {
 	Text *txt = text_load(NULL);
 	if (!txt)
 		return NULL;
-	char buf[1024];
-	for (ssize_t len = 0; (len = read(fd, buf, sizeof buf)) > 0;)
-		text_insert(txt, text_size(txt), buf, len);
-	txt->saved_action = txt->undo;
-	text_snapshot(txt);
 	txt->fd = fd;
+	txt->loading = true;
 	return txt;
 }
 
+/* read directly into the most recently allocated buffer and extend the last
+ * piece if the data is contiguous. this is not recorded as a change because
+ * the text can not be modified while it is being loaded. */
+ssize_t text_load_more(Text *txt, size_t len) {
+	size_t done = 0;
+	ssize_t n = 0;
+	while (txt->loading && done < len) {
+		Buffer *buf = txt->buffers;
+		if ((!buf || !buffer_capacity(buf, 1)) && !(buf = buffer_alloc(txt, len - done)))
+			return -1;
+		size_t count = MIN(len - done, buf->size - buf->len);
+		n = read(txt->fd, buf->data + buf->len, count);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n <= 0) {
+			if (n == 0 || errno != EAGAIN)
+				txt->loading = false;
+			break;
+		}
+		Piece *p = txt->end.prev;
+		if (p != &txt->begin && p->data + p->len == buf->data + buf->len) {
+			p->len += n;
+		} else {
+			Piece *new = piece_alloc(txt);
+			if (!new)
+				return -1;
+			piece_init(new, p, &txt->end, buf->data + buf->len, n);
+			p->next = new;
+			txt->end.prev = new;
+		}
+		buf->len += n;
+		txt->size += n;
+		text_changed(txt, txt->size - n, 0, n);
+		done += n;
+		/* a short read means no more data is currently available */
+		if ((size_t)n < count)
+			break;
+	}
+	return done > 0 || n == 0 ? (ssize_t)done : -1;
+}
+
+bool text_loading(Text *txt) {
+	return txt->loading;
+}
+
 static void print_piece(Piece *p) {
 	fprintf(stdout, "index: %d\tnext: %d\tprev: %d\t len: %zd\t data: %p\n", p->index,
 		p->next ? p->next->index : -1,
@@ -788,7 +2275,7 @@ void text_debug(Text *txt) {
 bool text_delete(Text *txt, size_t pos, size_t len) {
 	if (len == 0)
 		return true;
-	if (pos + len > txt->size)
+	if (pos + len > txt->size || txt->loading)
 		return false;
 	if (pos < txt->lines.pos)
 		lineno_cache_invalidate(&txt->lines);
@@ -798,8 +2285,10 @@ bool text_delete(Text *txt, size_t pos, size_t len) {
 	if (!p)
 		return false;
 	size_t off = loc.off;
-	if (cache_delete(txt, p, off, len))
+	if (cache_delete(txt, p, off, len)) {
+		text_changed(txt, pos, len, 0);
 		return true;
+	}
 	size_t cur; // how much has already been deleted
 	bool midway_start = false, midway_end = false;
 	Change *c = change_alloc(txt, pos);
@@ -861,6 +2350,7 @@ bool text_delete(Text *txt, size_t pos, size_t len) {
 	span_init(&c->new, new_start, new_end);
 	span_init(&c->old, start, end);
 	span_swap(txt, &c->old, &c->new);
+	text_changed(txt, pos, len, 0);
 	return true;
 }
 
@@ -875,6 +2365,15 @@ void text_free(Text *txt) {
 	if (!txt)
 		return;
 
+	text_save_finish(txt);
+	history_store(txt);
+	/* the modifications were either saved or deliberately discarded */
+	if (txt->recovery.fd != -1) {
+		close(txt->recovery.fd);
+		recovery_remove(txt);
+	}
+	free(txt->recovery.data);
+
 	Action *a;
 	while ((a = action_pop(&txt->undo)))
 		action_free(a);
@@ -891,13 +2390,555 @@ void text_free(Text *txt) {
 		buffer_free(buf);
 	}
 
+	lineindex_free(txt);
 	if (txt->buf.data)
 		munmap(txt->buf.data, txt->buf.size);
 
+	free(txt->matches.matches);
 	free(txt->filename);
+	free(txt->history_dir);
+	free(txt->lineindex_dir);
 	free(txt);
 }
 
+/* release all buffers which are not referenced by any piece */
+static void buffers_collect(Text *txt) {
+	for (Buffer **prev = &txt->buffers, *buf = *prev; buf; buf = *prev) {
+		bool used = false;
+		for (Piece *p = txt->pieces; p && !used; p = p->global_next)
+			used = p->len && buf->data <= p->data && p->data < buf->data + buf->size;
+		if (used) {
+			prev = &buf->next;
+			continue;
+		}
+		*prev = buf->next;
+		if (!buf->mapped)
+			txt->heap_size -= buf->size;
+		buffer_free(buf);
+	}
+}
+
+bool text_rebase(Text *txt, bool history) {
+	struct stat info;
+	/* a persisted history refers to the current file content */
+	history_restore(txt);
+	if (!txt->filename || txt->loading || txt->save || text_modified(txt) || txt->size == 0)
+		return false;
+	int fd = open(txt->filename, O_RDONLY);
+	if (fd == -1)
+		return false;
+	char *data = MAP_FAILED;
+	Piece *p = NULL;
+	Change *c = NULL;
+	if (fstat(fd, &info) == -1 || !S_ISREG(info.st_mode) || (size_t)info.st_size != txt->size)
+		goto err;
+	if ((data = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED)
+		goto err;
+	if (!(p = piece_alloc(txt)))
+		goto err;
+
+	text_snapshot(txt);
+	Action *a;
+	/* redo actions refer to pieces of the chain being replaced */
+	while ((a = action_pop(&txt->redo)))
+		action_free(a);
+	if (!history) {
+		while ((a = action_pop(&txt->undo)))
+			action_free(a);
+		txt->saved_action = NULL;
+	} else if (txt->undo) {
+		/* the replacement of the whole chain becomes the most recent change of
+		 * the last action, undoing it thus first restores the previous chain */
+		if (!(c = calloc(1, sizeof(Change))))
+			goto err;
+		c->next = txt->undo->change;
+		txt->undo->change = c;
+	}
+
+	piece_init(p, &txt->begin, &txt->end, data, txt->size);
+	if (c) {
+		span_init(&c->old, txt->begin.next, txt->end.prev);
+		span_init(&c->new, p, p);
+		span_swap(txt, &c->old, &c->new);
+	} else {
+		for (Piece *next, *old = txt->pieces; old; old = next) {
+			next = old->global_next;
+			if (old != p)
+				piece_free(old);
+		}
+		txt->begin.next = txt->end.prev = p;
+	}
+
+	lineindex_free(txt);
+	/* the previous file content is kept as long as it is referenced */
+	if (txt->buf.data) {
+		Buffer *buf = calloc(1, sizeof(Buffer));
+		if (buf) {
+			buf->data = txt->buf.data;
+			buf->size = buf->len = txt->buf.size;
+			buf->mapped = true;
+			buf->readonly = true;
+			buf->next = txt->buffers;
+			txt->buffers = buf;
+		} else {
+			/* can not be released, but is no longer used by the chain */
+			txt->buf.data = NULL;
+		}
+	}
+	if (txt->fd != -1)
+		close(txt->fd);
+	txt->fd = fd;
+	txt->info = info;
+	txt->saved_info = info;
+	txt->buf = (Buffer){ .data = data, .size = info.st_size, .len = info.st_size };
+	txt->followed = info.st_size;
+	txt->follow = NULL;
+	txt->stale = text_range_empty();
+	txt->cache = NULL;
+	buffers_collect(txt);
+	lineno_cache_invalidate(&txt->lines);
+	if (!lineindex_load(txt))
+		lineindex_start(txt);
+	return true;
+err:
+	if (p)
+		piece_free(p);
+	if (data != MAP_FAILED)
+		munmap(data, info.st_size);
+	close(fd);
+	return false;
+}
+
+/* The undo history is persisted as a copy of the piece graph in a file named
+ * after the device and inode number of the saved file. Pieces whose data is
+ * part of the file content refer to it by offset, the data of all others is
+ * stored in a page aligned section which is mmap(2)-ed when the history is
+ * restored. This only happens once it is needed, e.g. upon the first undo.
+ */
+#define HISTORY_MAGIC "visundo1"
+/* indices of the NULL pointer and the sentinel pieces, other pieces follow */
+enum { HISTORY_NULL, HISTORY_BEGIN, HISTORY_END, HISTORY_PIECES };
+
+typedef struct {
+	char magic[8];
+	uint64_t size;          /* file size at the time the history was stored */
+	int64_t mtime, mtime_nsec; /* modification time of the file */
+	uint64_t pieces;        /* number of HistoryPiece following the header */
+	uint64_t actions;       /* number of HistoryAction following the pieces */
+	uint64_t undo;          /* the first actions form the undo, the others the redo stack */
+	uint64_t changes;       /* number of HistoryChange following the actions */
+	uint64_t data;          /* page aligned offset of the data section */
+	uint64_t data_len;      /* its length in bytes */
+	uint32_t first, last;   /* piece chain corresponding to the file content */
+} HistoryHeader;
+
+typedef struct {
+	uint64_t off, len;      /* data location within the file or the data section */
+	uint32_t prev, next;    /* piece indices */
+	uint32_t stored;        /* whether the data is in the data section */
+	uint32_t padding;
+} HistoryPiece;
+
+typedef struct {
+	uint64_t changes;       /* number of changes, they are stored consecutively */
+	int64_t time;
+} HistoryAction;
+
+typedef struct {
+	uint32_t old_start, old_end, new_start, new_end;
+	uint64_t old_len, new_len, pos;
+} HistoryChange;
+
+/* a piece of the current chain or one whose data is stored in the data section */
+typedef struct {
+	const char *data;
+	size_t len;
+	size_t off;             /* offset in the file or the data section */
+} HistoryData;
+
+static char *history_name(Text *txt) {
+	char *name;
+	size_t len = strlen(txt->history_dir) + 2 * 16 + 3;
+	if (!(name = malloc(len)))
+		return NULL;
+	snprintf(name, len, "%s/%llx-%llx", txt->history_dir,
+	         (unsigned long long)txt->saved_info.st_dev,
+	         (unsigned long long)txt->saved_info.st_ino);
+	return name;
+}
+
+/* whether both refer to the same, unchanged file */
+static bool stat_same(const struct stat *a, const struct stat *b) {
+	return a->st_dev == b->st_dev && a->st_ino == b->st_ino && a->st_size == b->st_size &&
+	       a->st_mtime == b->st_mtime && MTIME_NSEC(a) == MTIME_NSEC(b);
+}
+
+static bool history_current(Text *txt, struct stat *info) {
+	return stat_same(info, &txt->saved_info);
+}
+
+static int history_data_cmp(const void *a, const void *b) {
+	uintptr_t x = (uintptr_t)((const HistoryData*)a)->data;
+	uintptr_t y = (uintptr_t)((const HistoryData*)b)->data;
+	return x < y ? -1 : x > y;
+}
+
+/* find the element of the sorted array whose data contains [data, data+len) */
+static HistoryData *history_data_find(HistoryData *d, size_t count, const char *data, size_t len) {
+	size_t lo = 0, hi = count;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if ((uintptr_t)d[mid].data <= (uintptr_t)data)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo == 0)
+		return NULL;
+	d += lo - 1;
+	if ((uintptr_t)data + len > (uintptr_t)d->data + d->len)
+		return NULL;
+	return d;
+}
+
+static bool history_write(FILE *file, HistoryHeader *hdr, Text *txt, HistoryPiece *pieces, HistoryData *stored, size_t count) {
+	if (fwrite(hdr, sizeof *hdr, 1, file) != 1 ||
+	    fwrite(pieces, sizeof *pieces, hdr->pieces, file) != hdr->pieces)
+		return false;
+	Action *stacks[] = { txt->undo, txt->redo };
+	for (int i = 0; i < 2; i++) {
+		for (Action *a = stacks[i]; a; a = a->next) {
+			HistoryAction action = { .time = a->time };
+			for (Change *c = a->change; c; c = c->next)
+				action.changes++;
+			if (fwrite(&action, sizeof action, 1, file) != 1)
+				return false;
+		}
+	}
+	for (int i = 0; i < 2; i++) {
+		for (Action *a = stacks[i]; a; a = a->next) {
+			for (Change *c = a->change; c; c = c->next) {
+				HistoryChange change = {
+					.old_start = c->old.start ? c->old.start->index : HISTORY_NULL,
+					.old_end = c->old.end ? c->old.end->index : HISTORY_NULL,
+					.new_start = c->new.start ? c->new.start->index : HISTORY_NULL,
+					.new_end = c->new.end ? c->new.end->index : HISTORY_NULL,
+					.old_len = c->old.len,
+					.new_len = c->new.len,
+					.pos = c->pos,
+				};
+				if (fwrite(&change, sizeof change, 1, file) != 1)
+					return false;
+			}
+		}
+	}
+	if (fseek(file, hdr->data, SEEK_SET) == -1)
+		return false;
+	for (size_t i = 0; i < count; i++) {
+		if (fwrite(stored[i].data, 1, stored[i].len, file) != stored[i].len)
+			return false;
+	}
+	return true;
+}
+
+/* store the undo history if the text content corresponds to its file */
+static bool history_store(Text *txt) {
+	struct stat info;
+	if (!txt->history_dir || !txt->filename || txt->loading || txt->size == 0)
+		return false;
+	/* a history which was never restored remains valid if nothing changed */
+	if (!txt->history_restored && !txt->undo && !txt->redo)
+		return false;
+	history_restore(txt);
+	if ((!txt->undo && !txt->redo) || text_modified(txt) ||
+	    stat(txt->filename, &info) == -1 || !history_current(txt, &info) ||
+	    (size_t)info.st_size != txt->size)
+		return false;
+
+	bool ret = false;
+	char *name = NULL, *tmpname = NULL;
+	FILE *file = NULL;
+	HistoryPiece *pieces = NULL;
+	HistoryData *chain = NULL, *stored = NULL;
+	size_t piece_count = 0, chain_count = 0, stored_count = 0, pos = 0;
+
+	/* number all pieces, the indices are only used for debugging otherwise */
+	for (Piece *p = txt->pieces; p; p = p->global_next)
+		p->index = HISTORY_PIECES + piece_count++;
+	txt->begin.index = HISTORY_BEGIN;
+	txt->end.index = HISTORY_END;
+	for (Piece *p = txt->begin.next; p != &txt->end; p = p->next)
+		chain_count++;
+	if (!(pieces = calloc(piece_count, sizeof *pieces)) ||
+	    !(chain = calloc(chain_count, sizeof *chain)) ||
+	    !(stored = calloc(piece_count, sizeof *stored)))
+		goto out;
+	chain_count = 0;
+	for (Piece *p = txt->begin.next; p != &txt->end; pos += p->len, p = p->next)
+		chain[chain_count++] = (HistoryData){ .data = p->data, .len = p->len, .off = pos };
+	qsort(chain, chain_count, sizeof *chain, history_data_cmp);
+
+	/* pieces whose data is not part of the file content need to be stored */
+	for (Piece *p = txt->pieces; p; p = p->global_next) {
+		HistoryPiece *hp = &pieces[p->index - HISTORY_PIECES];
+		hp->len = p->len;
+		hp->prev = p->prev ? p->prev->index : HISTORY_NULL;
+		hp->next = p->next ? p->next->index : HISTORY_NULL;
+		HistoryData *d = history_data_find(chain, chain_count, p->data, p->len);
+		if (d)
+			hp->off = d->off + (p->data - d->data);
+		else if (p->len)
+			stored[stored_count++] = (HistoryData){ .data = p->data, .len = p->len, .off = p->index };
+	}
+	/* merge overlapping data, such that it is only stored once */
+	qsort(stored, stored_count, sizeof *stored, history_data_cmp);
+	size_t data_len = 0, count = 0;
+	for (size_t i = 0; i < stored_count; i++) {
+		HistoryData *d = &stored[i];
+		HistoryData *prev = count ? &stored[count-1] : NULL;
+		HistoryPiece *hp = &pieces[d->off - HISTORY_PIECES];
+		if (prev && d->data <= prev->data + prev->len) {
+			if (d->data + d->len > prev->data + prev->len) {
+				size_t len = d->data + d->len - (prev->data + prev->len);
+				prev->len += len;
+				data_len += len;
+			}
+		} else {
+			prev = &stored[count++];
+			*prev = (HistoryData){ .data = d->data, .len = d->len, .off = data_len };
+			data_len += d->len;
+		}
+		hp->stored = true;
+		hp->off = prev->off + (d->data - prev->data);
+	}
+
+	HistoryHeader hdr = {
+		.magic = HISTORY_MAGIC,
+		.size = txt->size,
+		.mtime = info.st_mtime,
+		.mtime_nsec = MTIME_NSEC(&info),
+		.pieces = piece_count,
+		.first = txt->begin.next->index,
+		.last = txt->end.prev->index,
+		.data_len = data_len,
+	};
+	for (Action *a = txt->undo; a; a = a->next, hdr.undo++) {
+		for (Change *c = a->change; c; c = c->next)
+			hdr.changes++;
+	}
+	for (Action *a = txt->redo; a; a = a->next, hdr.actions++) {
+		for (Change *c = a->change; c; c = c->next)
+			hdr.changes++;
+	}
+	hdr.actions += hdr.undo;
+	size_t pagesize = sysconf(_SC_PAGESIZE);
+	hdr.data = sizeof hdr + hdr.pieces * sizeof(HistoryPiece) +
+	           hdr.actions * sizeof(HistoryAction) + hdr.changes * sizeof(HistoryChange);
+	hdr.data += pagesize - 1 - (hdr.data + pagesize - 1) % pagesize;
+
+	if (!(name = history_name(txt)) || !(tmpname = malloc(strlen(name) + 8)))
+		goto out;
+	sprintf(tmpname, "%s.XXXXXX", name);
+	int fd = mkstemp(tmpname);
+	if (fd == -1)
+		goto out;
+	if (!(file = fdopen(fd, "w"))) {
+		close(fd);
+		goto err;
+	}
+	if (!history_write(file, &hdr, txt, pieces, stored, count))
+		goto err;
+	ret = fclose(file) == 0 && rename(tmpname, name) == 0;
+	file = NULL;
+err:
+	if (file)
+		fclose(file);
+	if (!ret)
+		unlink(tmpname);
+out:
+	free(name);
+	free(tmpname);
+	free(pieces);
+	free(chain);
+	free(stored);
+	return ret;
+}
+
+/* remove the persisted history of the file content as of the last save */
+static void history_remove(Text *txt) {
+	char *name;
+	if (!txt->history_dir || !(name = history_name(txt)))
+		return;
+	unlink(name);
+	free(name);
+}
+
+static void history_actions_free(Action *a) {
+	for (Action *next; a; a = next) {
+		next = a->next;
+		for (Change *c_next, *c = a->change; c; c = c_next) {
+			c_next = c->next;
+			free(c);
+		}
+		free(a);
+	}
+}
+
+/* restore a persisted undo history, it becomes the oldest part of the current one */
+static void history_restore(Text *txt) {
+	if (txt->history_restored || !txt->history_dir || !txt->filename || !txt->buf.data)
+		return;
+	txt->history_restored = true;
+
+	struct stat info;
+	HistoryHeader *hdr = MAP_FAILED;
+	Piece **pieces = NULL, *base = NULL;
+	Action *undo = NULL, *redo = NULL;
+	Change *bridge = NULL;
+	Buffer *buf = NULL;
+	size_t map_len = 0, piece_count = HISTORY_PIECES;
+	char *name = history_name(txt);
+	if (!name)
+		return;
+	int fd = open(name, O_RDONLY);
+	if (fd == -1 || fstat(fd, &info) == -1 || (size_t)info.st_size < sizeof *hdr)
+		goto out;
+	map_len = info.st_size;
+	if ((hdr = mmap(NULL, map_len, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+		goto out;
+
+	size_t pagesize = sysconf(_SC_PAGESIZE);
+	if (memcmp(hdr->magic, HISTORY_MAGIC, sizeof hdr->magic) ||
+	    hdr->size != (uint64_t)txt->saved_info.st_size || hdr->size != txt->buf.size ||
+	    hdr->mtime != txt->saved_info.st_mtime ||
+	    hdr->mtime_nsec != MTIME_NSEC(&txt->saved_info) ||
+	    hdr->undo > hdr->actions || hdr->data % pagesize || hdr->data > map_len ||
+	    hdr->data_len > map_len - hdr->data ||
+	    hdr->pieces > (hdr->data - sizeof *hdr) / sizeof(HistoryPiece) ||
+	    hdr->actions > (hdr->data - sizeof *hdr) / sizeof(HistoryAction) ||
+	    hdr->changes > (hdr->data - sizeof *hdr) / sizeof(HistoryChange) ||
+	    sizeof *hdr + hdr->pieces * sizeof(HistoryPiece) + hdr->actions * sizeof(HistoryAction) +
+	    hdr->changes * sizeof(HistoryChange) > hdr->data)
+		goto out;
+
+	/* the piece referring to the whole file as loaded */
+	for (Piece *p = txt->pieces; p && !base; p = p->global_next) {
+		if (p->data == txt->buf.data && p->len == txt->buf.size)
+			base = p;
+	}
+	if (!base)
+		goto out;
+	bool replace = !txt->undo && !txt->redo && txt->begin.next == base && base->next == &txt->end;
+	if (!replace && !hdr->undo)
+		goto out;
+
+	const char *data = (const char*)hdr + hdr->data;
+	HistoryPiece *hp = (HistoryPiece*)(hdr + 1);
+	HistoryAction *ha = (HistoryAction*)(hp + hdr->pieces);
+	HistoryChange *hc = (HistoryChange*)(ha + hdr->actions), *hc_end = hc + hdr->changes;
+	size_t count = HISTORY_PIECES + hdr->pieces;
+	if (hdr->first < HISTORY_PIECES || hdr->first >= count ||
+	    hdr->last < HISTORY_PIECES || hdr->last >= count ||
+	    !(pieces = calloc(count, sizeof *pieces)))
+		goto out;
+	pieces[HISTORY_BEGIN] = &txt->begin;
+	pieces[HISTORY_END] = &txt->end;
+	for (; piece_count < count; piece_count++) {
+		HistoryPiece *h = &hp[piece_count - HISTORY_PIECES];
+		if (h->prev >= count || h->next >= count || h->off + h->len < h->off ||
+		    h->off + h->len > (h->stored ? hdr->data_len : hdr->size))
+			goto err;
+		if (!(pieces[piece_count] = piece_alloc(txt)))
+			goto err;
+	}
+	for (size_t i = HISTORY_PIECES; i < count; i++) {
+		HistoryPiece *h = &hp[i - HISTORY_PIECES];
+		const char *start = h->stored ? data : txt->buf.data;
+		piece_init(pieces[i], pieces[h->prev], pieces[h->next], start + h->off, h->len);
+	}
+
+	Action **tail = hdr->undo ? &undo : &redo;
+	for (size_t i = 0; i < hdr->actions; i++) {
+		Action *a = calloc(1, sizeof *a);
+		if (!a)
+			goto err;
+		a->time = ha[i].time;
+		*tail = a;
+		tail = i + 1 == hdr->undo ? &redo : &a->next;
+		Change **c = &a->change;
+		for (uint64_t j = 0; j < ha[i].changes; j++, c = &(*c)->next, hc++) {
+			if (hc == hc_end || hc->old_start >= count || hc->old_end >= count ||
+			    hc->new_start >= count || hc->new_end >= count || !(*c = calloc(1, sizeof **c)))
+				goto err;
+			**c = (Change){
+				.old = { pieces[hc->old_start], pieces[hc->old_end], hc->old_len },
+				.new = { pieces[hc->new_start], pieces[hc->new_end], hc->new_len },
+				.pos = hc->pos,
+			};
+		}
+	}
+
+	if ((!replace && !(bridge = calloc(1, sizeof *bridge))) ||
+	    (hdr->data_len && !(buf = calloc(1, sizeof *buf))))
+		goto err;
+
+	text_snapshot(txt);
+	if (replace) {
+		/* nothing happened yet, continue from the restored state */
+		txt->begin.next = pieces[hdr->first];
+		txt->end.prev = pieces[hdr->last];
+		piece_free(base);
+		txt->undo = undo;
+		txt->redo = redo;
+	} else {
+		/* undoing the most recent restored action first swaps the chain
+		 * corresponding to the file content in place of the initial piece.
+		 * the restored redo actions are obsoleted by the changes made since */
+		span_init(&bridge->old, pieces[hdr->first], pieces[hdr->last]);
+		span_init(&bridge->new, base, base);
+		bridge->next = undo->change;
+		undo->change = bridge;
+		Action **bottom = &txt->undo;
+		while (*bottom)
+			bottom = &(*bottom)->next;
+		*bottom = undo;
+		for (Action *a; (a = action_pop(&redo)); )
+			action_free(a);
+	}
+	if (!txt->saved_action)
+		txt->saved_action = undo;
+
+	if (buf) {
+		/* the data section remains mapped, the rest is no longer needed */
+		buf->data = (char*)data;
+		buf->size = buf->len = hdr->data_len;
+		buf->mapped = true;
+		buf->readonly = true;
+		if (txt->buffers) {
+			buf->next = txt->buffers->next;
+			txt->buffers->next = buf;
+		} else {
+			txt->buffers = buf;
+		}
+		map_len = hdr->data;
+	}
+	goto out;
+err:
+	/* the pieces are freed below, not by the changes referring to them */
+	history_actions_free(undo);
+	history_actions_free(redo);
+	for (size_t i = HISTORY_PIECES; i < piece_count; i++)
+		piece_free(pieces[i]);
+	free(bridge);
+out:
+	if (hdr != MAP_FAILED)
+		munmap(hdr, map_len);
+	if (fd != -1)
+		close(fd);
+	free(pieces);
+	free(name);
+}
+
 bool text_modified(Text *txt) {
 	return txt->saved_action != txt->undo;
 }
@@ -1050,11 +3091,272 @@ size_t text_size(Text *txt) {
 	return txt->size;
 }
 
+/* count the new lines in [data, data+len) a word at a time: a byte of w ^ nl is
+ * zero iff it is a new line, in which case its most significant bit in t is not set */
+static size_t memcount(const char *data, size_t len) {
+	const uint64_t ones = 0x0101010101010101, high = 0x8080808080808080;
+	const uint64_t low = ~high, nl = '\n' * ones;
+	size_t lines = 0, i = 0;
+	for (; i + 8 <= len; i += 8) {
+		uint64_t w;
+		memcpy(&w, data + i, sizeof w);
+		w ^= nl;
+		uint64_t t = ((w & low) + low) | w;
+		lines += (((~t & high) >> 7) * ones) >> 56;
+	}
+	for (; i < len; i++)
+		lines += data[i] == '\n';
+	return lines;
+}
+
+static char *lineindex_name(Text *txt) {
+	char *name;
+	size_t len = strlen(txt->lineindex_dir) + 2 * 16 + 3;
+	if (!(name = malloc(len)))
+		return NULL;
+	snprintf(name, len, "%s/%llx-%llx", txt->lineindex_dir,
+	         (unsigned long long)txt->info.st_dev,
+	         (unsigned long long)txt->info.st_ino);
+	return name;
+}
+
+static void lineindex_header(Text *txt, LineIndexHeader *hdr) {
+	memset(hdr, 0, sizeof *hdr);
+	memcpy(hdr->magic, LINEINDEX_MAGIC, sizeof hdr->magic);
+	hdr->dev = txt->info.st_dev;
+	hdr->ino = txt->info.st_ino;
+	hdr->size = txt->buf.size;
+	hdr->mtime = txt->info.st_mtime;
+	hdr->mtime_nsec = MTIME_NSEC(&txt->info);
+	hdr->step = LINEINDEX_STEP;
+	hdr->count = txt->buf.size / LINEINDEX_STEP + 1;
+}
+
+/* whether buf still corresponds to the content of the file */
+static bool lineindex_current(Text *txt) {
+	struct stat info;
+	return txt->lineindex_dir && txt->filename && txt->buf.data &&
+	       !text_range_valid(&txt->stale) && stat(txt->filename, &info) == 0 &&
+	       stat_same(&info, &txt->info);
+}
+
+static bool lineindex_store(Text *txt) {
+	LineIndex *idx = &txt->lineindex;
+	LineIndexHeader hdr;
+	FILE *file = NULL;
+	char *name = NULL, *tmpname = NULL;
+	bool ret = false;
+	if (!lineindex_current(txt))
+		return false;
+	lineindex_header(txt, &hdr);
+	if (!(name = lineindex_name(txt)) || !(tmpname = malloc(strlen(name) + 8)))
+		goto out;
+	sprintf(tmpname, "%s.XXXXXX", name);
+	int fd = mkstemp(tmpname);
+	if (fd == -1 && errno == ENOENT && mkdirs(txt->lineindex_dir)) {
+		sprintf(tmpname, "%s.XXXXXX", name);
+		fd = mkstemp(tmpname);
+	}
+	if (fd == -1)
+		goto out;
+	if (!(file = fdopen(fd, "w"))) {
+		close(fd);
+		goto err;
+	}
+	if (fwrite(&hdr, sizeof hdr, 1, file) != 1 ||
+	    fwrite(idx->lines, sizeof *idx->lines, idx->count, file) != idx->count)
+		goto err;
+	ret = fclose(file) == 0 && rename(tmpname, name) == 0;
+	file = NULL;
+err:
+	if (file)
+		fclose(file);
+	if (!ret)
+		unlink(tmpname);
+out:
+	free(name);
+	free(tmpname);
+	return ret;
+}
+
+static void *lineindex_thread(void *arg) {
+	LineIndexWorker *w = arg;
+	memory_advise(w->data, w->steps * LINEINDEX_STEP, TEXT_ADVICE_SEQUENTIAL);
+	for (size_t i = 0; i < w->steps; i++) {
+		pthread_mutex_lock(w->lock);
+		bool cancel = *w->cancel;
+		pthread_mutex_unlock(w->lock);
+		if (cancel)
+			break;
+		w->lines[i] = memcount(w->data + i * LINEINDEX_STEP, LINEINDEX_STEP);
+	}
+	memory_advise(w->data, w->steps * LINEINDEX_STEP, TEXT_ADVICE_NORMAL);
+	return NULL;
+}
+
+/* count the lines of a large buf in the background, split among all processors */
+static void lineindex_start(Text *txt) {
+	LineIndex *idx = &txt->lineindex;
+	if (idx->lines || idx->workers || txt->buf.size < LINEINDEX_MIN)
+		return;
+	size_t steps = txt->buf.size / LINEINDEX_STEP;
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	int n = cpus < 1 ? 1 : MIN(cpus, LINEINDEX_THREADS);
+	if (!(idx->counts = malloc((steps + 1) * sizeof *idx->counts)) ||
+	    !(idx->workers = calloc(n, sizeof *idx->workers))) {
+		free(idx->counts);
+		idx->counts = NULL;
+		return;
+	}
+	idx->nworkers = n;
+	idx->cancel = false;
+	pthread_mutex_init(&idx->lock, NULL);
+	/* signals are handled by the main thread */
+	sigset_t all, old;
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	for (size_t i = 0, first = 0; i < (size_t)n; i++) {
+		LineIndexWorker *w = &idx->workers[i];
+		w->steps = steps / n + (i < steps % n);
+		w->data = txt->buf.data + first * LINEINDEX_STEP;
+		w->lines = idx->counts + 1 + first;
+		w->lock = &idx->lock;
+		w->cancel = &idx->cancel;
+		w->running = pthread_create(&w->thread, NULL, lineindex_thread, w) == 0;
+		first += w->steps;
+	}
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+}
+
+/* wait for the workers, unless they were cancelled their counts form the index */
+static void lineindex_finish(Text *txt) {
+	LineIndex *idx = &txt->lineindex;
+	if (!idx->workers)
+		return;
+	for (int i = 0; i < idx->nworkers; i++) {
+		LineIndexWorker *w = &idx->workers[i];
+		if (w->running)
+			pthread_join(w->thread, NULL);
+		else if (!idx->cancel)
+			lineindex_thread(w);
+	}
+	pthread_mutex_destroy(&idx->lock);
+	free(idx->workers);
+	idx->workers = NULL;
+	idx->nworkers = 0;
+	if (idx->cancel) {
+		free(idx->counts);
+	} else {
+		idx->count = txt->buf.size / LINEINDEX_STEP + 1;
+		idx->lines = idx->counts;
+		idx->lines[0] = 0;
+		for (size_t i = 1; i < idx->count; i++)
+			idx->lines[i] += idx->lines[i-1];
+		lineindex_store(txt);
+	}
+	idx->counts = NULL;
+}
+
+static void lineindex_stop(Text *txt) {
+	LineIndex *idx = &txt->lineindex;
+	if (!idx->workers)
+		return;
+	pthread_mutex_lock(&idx->lock);
+	idx->cancel = true;
+	pthread_mutex_unlock(&idx->lock);
+	lineindex_finish(txt);
+}
+
+/* use a cached index of a previous session if the file was not changed since */
+static bool lineindex_load(Text *txt) {
+	LineIndex *idx = &txt->lineindex;
+	LineIndexHeader hdr, expected;
+	uint64_t *lines = NULL;
+	FILE *file = NULL;
+	char *name = NULL;
+	if (idx->lines || txt->buf.size < LINEINDEX_MIN || !lineindex_current(txt))
+		return false;
+	lineindex_header(txt, &expected);
+	if (!(name = lineindex_name(txt)) || !(file = fopen(name, "r")))
+		goto err;
+	if (fread(&hdr, sizeof hdr, 1, file) != 1 || memcmp(&hdr, &expected, sizeof hdr))
+		goto err;
+	if (!(lines = malloc(hdr.count * sizeof *lines)) ||
+	    fread(lines, sizeof *lines, hdr.count, file) != hdr.count)
+		goto err;
+	if (lines[0] != 0)
+		goto err;
+	for (size_t i = 1; i < hdr.count; i++) {
+		if (lines[i] < lines[i-1] || lines[i] - lines[i-1] > LINEINDEX_STEP)
+			goto err;
+	}
+	/* no need to count them again */
+	lineindex_stop(txt);
+	idx->lines = lines;
+	idx->count = hdr.count;
+	fclose(file);
+	free(name);
+	return true;
+err:
+	if (file)
+		fclose(file);
+	free(name);
+	free(lines);
+	return false;
+}
+
+static void lineindex_free(Text *txt) {
+	lineindex_stop(txt);
+	free(txt->lineindex.lines);
+	txt->lineindex = (LineIndex){ 0 };
+}
+
+/* get the line index if it is worth using for [data, data+len), which has to
+ * lie within buf. if it is still being built, wait for it to complete */
+static LineIndex *lineindex_get(Text *txt, const char *data, size_t len) {
+	LineIndex *idx = &txt->lineindex;
+	if (len < 2 * LINEINDEX_STEP || txt->buf.size < LINEINDEX_MIN ||
+	    data < txt->buf.data || data + len > txt->buf.data + txt->buf.size)
+		return NULL;
+	if (!idx->lines && !idx->failed) {
+		lineindex_start(txt);
+		lineindex_finish(txt);
+		idx->failed = !idx->lines;
+	}
+	return idx->lines ? idx : NULL;
+}
+
+/* number of new lines in the first off bytes of buf */
+static size_t lineindex_lines(Text *txt, size_t off) {
+	size_t i = off / LINEINDEX_STEP;
+	return txt->lineindex.lines[i] + memcount(txt->buf.data + i * LINEINDEX_STEP, off % LINEINDEX_STEP);
+}
+
+/* find the last checkpoint preceded by less than lines new lines */
+static size_t lineindex_find(LineIndex *idx, size_t lines) {
+	size_t lo = 0, hi = idx->count;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (idx->lines[mid] < lines)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo ? lo - 1 : 0;
+}
+
 /* count the number of new lines '\n' in range [pos, pos+len) */
 static size_t lines_count(Text *txt, size_t pos, size_t len) {
 	size_t lines = 0;
 	text_iterate(txt, it, pos) {
 		const char *start = it.text;
+		size_t n = MIN(len, (size_t)(it.end - start));
+		if (lineindex_get(txt, start, n)) {
+			size_t off = start - txt->buf.data;
+			lines += lineindex_lines(txt, off + n) - lineindex_lines(txt, off);
+			len -= n;
+			start += n;
+		}
 		while (len > 0 && start < it.end) {
 			size_t n = MIN(len, (size_t)(it.end - start));
 			const char *end = memchr(start, '\n', n);
@@ -1078,6 +3380,25 @@ static size_t lines_skip_forward(Text *txt, size_t pos, size_t lines, size_t *li
 	size_t lines_old = lines;
 	text_iterate(txt, it, pos) {
 		const char *start = it.text;
+		LineIndex *idx = lineindex_get(txt, start, it.end - start);
+		if (idx && lines > 0) {
+			size_t off = start - txt->buf.data, end = it.end - txt->buf.data;
+			size_t before = lineindex_lines(txt, off);
+			size_t total = lineindex_lines(txt, end) - before;
+			if (total < lines) {
+				pos += end - off;
+				lines -= total;
+				continue;
+			}
+			/* scan only from the checkpoint preceding the target line */
+			size_t i = lineindex_find(idx, before + lines);
+			size_t checkpoint = i * LINEINDEX_STEP;
+			if (checkpoint > off) {
+				pos += checkpoint - off;
+				lines -= idx->lines[i] - before;
+				start = txt->buf.data + checkpoint;
+			}
+		}
 		while (lines > 0 && start < it.end) {
 			size_t n = it.end - start;
 			const char *end = memchr(start, '\n', n);
@@ -1165,6 +3486,7 @@ size_t text_mark_get(Text *txt, Mark mark) {
 }
 
 size_t text_history_get(Text *txt, size_t index) {
+	history_restore(txt);
 	for (Action *a = txt->current_action ? txt->current_action : txt->undo; a; a = a->next) {
 		if (index-- == 0) {
 			Change *c = a->change;
@@ -1176,6 +3498,10 @@ size_t text_history_get(Text *txt, size_t index) {
 	return EPOS;
 }
 
+size_t text_revision(Text *txt) {
+	return txt->revision;
+}
+
 int text_fd_get(Text *txt) {
 	return txt->fd;
 }
@@ -1185,10 +3511,49 @@ const char *text_filename_get(Text *txt) {
 }
 
 void text_filename_set(Text *txt, const char *filename) {
+	/* the journal refers to the previous file */
+	if (txt->recovery.fd != -1 && (!filename || strcmp(filename, txt->filename))) {
+		close(txt->recovery.fd);
+		txt->recovery.fd = -1;
+		txt->recovery.len = 0;
+		recovery_remove(txt);
+	}
+	if (!filename || !txt->filename || strcmp(filename, txt->filename))
+		txt->recovery.checked = txt->recovery.previous = false;
 	free(txt->filename);
 	txt->filename = filename ? strdup(filename) : NULL;
 }
 
+void text_heap_limit_set(Text *txt, size_t limit) {
+	txt->heap_limit = limit;
+}
+
+size_t text_heap_size(Text *txt) {
+	return txt->heap_size;
+}
+
+void text_lineindex_dir_set(Text *txt, const char *dir) {
+	free(txt->lineindex_dir);
+	txt->lineindex_dir = dir ? strdup(dir) : NULL;
+	/* only count the lines if no cached index is found */
+	if (!lineindex_load(txt))
+		lineindex_start(txt);
+}
+
+void text_history_dir_set(Text *txt, const char *dir) {
+	free(txt->history_dir);
+	txt->history_dir = dir ? strdup(dir) : NULL;
+}
+
+void text_progress_set(Text *txt, bool (*progress)(void *data, size_t done, size_t total), void *data) {
+	txt->progress = progress;
+	txt->progress_data = data;
+}
+
+static bool text_progress(Text *txt, size_t done, size_t total) {
+	return !txt->progress || txt->progress(txt->progress_data, done, total);
+}
+
 Regex *text_regex_new(void) {
 	Regex *r = calloc(1, sizeof(Regex));
 	if (!r)
@@ -1199,6 +3564,9 @@ Regex *text_regex_new(void) {
 
 int text_regex_compile(Regex *regex, const char *string, int cflags) {
 	regex->string = string;
+	static int generation;
+	regex->generation = ++generation;
+	regfree(&regex->regex);
 	int r = regcomp(&regex->regex, string, cflags);
 	if (r)
 		regcomp(&regex->regex, "\0\0", 0);
@@ -1212,45 +3580,333 @@ void text_regex_free(Regex *r) {
 	free(r);
 }
 
+/* large ranges of a text which reports progress are searched in chunks of twice
+ * PROGRESS_INTERVAL bytes, each overlapping the previous one by half. this bounds
+ * memory usage and allows to report progress in between. only matches longer than
+ * PROGRESS_INTERVAL and spanning a chunk boundary are not found. */
 int text_search_range_forward(Text *txt, size_t pos, size_t len, Regex *r, size_t nmatch, RegexMatch pmatch[], int eflags) {
-	char *buf = malloc(len + 1);
+	len = pos < txt->size ? MIN(len, txt->size - pos) : 0;
+	size_t chunk = txt->progress ? PROGRESS_INTERVAL : MAX(len, 1);
+	char *buf = malloc(MIN(len, 2 * chunk) + 1);
 	if (!buf)
 		return REG_NOMATCH;
-	len = text_bytes_get(txt, pos, len, buf);
-	buf[len] = '\0';
 	regmatch_t match[nmatch];
-	int ret = regexec(&r->regex, buf, nmatch, match, eflags);
-	if (!ret) {
-		for (size_t i = 0; i < nmatch; i++) {
-			pmatch[i].start = match[i].rm_so == -1 ? EPOS : pos + match[i].rm_so;
-			pmatch[i].end = match[i].rm_eo == -1 ? EPOS : pos + match[i].rm_eo;
+	int ret;
+	size_t off = 0;
+	text_advise(txt, pos, len, TEXT_ADVICE_SEQUENTIAL);
+	do {
+		size_t n = text_bytes_get(txt, pos + off, MIN(len - off, 2 * chunk), buf);
+		buf[n] = '\0';
+		bool last = off + n >= len;
+		int flags = eflags | (off > 0 ? REG_NOTBOL : 0) | (!last ? REG_NOTEOL : 0);
+		ret = regexec(&r->regex, buf, nmatch, match, flags);
+		if (!ret && !last && (size_t)match[0].rm_eo == n && match[0].rm_so > 0) {
+			/* the match might continue beyond the chunk, search again from its start */
+			off += match[0].rm_so;
+			ret = REG_NOMATCH;
+			continue;
 		}
-	}
+		if (!ret) {
+			for (size_t i = 0; i < nmatch; i++) {
+				pmatch[i].start = match[i].rm_so == -1 ? EPOS : pos + off + match[i].rm_so;
+				pmatch[i].end = match[i].rm_eo == -1 ? EPOS : pos + off + match[i].rm_eo;
+			}
+		}
+		off += last ? n : chunk;
+	} while (ret && off < len && text_progress(txt, off, len));
+	text_advise(txt, pos, len, TEXT_ADVICE_NORMAL);
 	free(buf);
 	return ret;
 }
 
+/* like the forward search, chunks are processed from the end of the range */
 int text_search_range_backward(Text *txt, size_t pos, size_t len, Regex *r, size_t nmatch, RegexMatch pmatch[], int eflags) {
-	char *buf = malloc(len + 1);
+	len = pos < txt->size ? MIN(len, txt->size - pos) : 0;
+	size_t chunk = txt->progress ? PROGRESS_INTERVAL : MAX(len, 1);
+	char *buf = malloc(MIN(len, 2 * chunk) + 1);
 	if (!buf)
 		return REG_NOMATCH;
-	len = text_bytes_get(txt, pos, len, buf);
-	buf[len] = '\0';
 	regmatch_t match[nmatch];
-	char *cur = buf;
 	int ret = REG_NOMATCH;
-	while (!regexec(&r->regex, cur, nmatch, match, eflags)) {
-		ret = 0;
-		for (size_t i = 0; i < nmatch; i++) {
-			pmatch[i].start = match[i].rm_so == -1 ? EPOS : pos + (size_t)(cur - buf) + match[i].rm_so;
-			pmatch[i].end = match[i].rm_eo == -1 ? EPOS : pos + (size_t)(cur - buf) + match[i].rm_eo;
+	size_t end = len;
+	do {
+		size_t start = end - MIN(end, 2 * chunk);
+		/* read the preceding chunk ahead while this one is searched */
+		if (start > 0) {
+			size_t ahead = MIN(start, chunk);
+			text_advise(txt, pos + start - ahead, ahead, TEXT_ADVICE_WILLNEED);
 		}
-		cur += match[0].rm_eo;
-	}
+		size_t n = text_bytes_get(txt, pos + start, end - start, buf);
+		buf[n] = '\0';
+		int flags = eflags | (end < len ? REG_NOTEOL : 0);
+		for (char *cur = buf; !regexec(&r->regex, cur, nmatch, match, flags | (start > 0 || cur > buf ? REG_NOTBOL : 0)); ) {
+			/* a match at the start of the chunk might begin before it,
+			 * the next chunk covers it completely */
+			ret = cur == buf && match[0].rm_so == 0 && start > 0 ? REG_NOMATCH : 0;
+			for (size_t i = 0; !ret && i < nmatch; i++) {
+				pmatch[i].start = match[i].rm_so == -1 ? EPOS : pos + start + (size_t)(cur - buf) + match[i].rm_so;
+				pmatch[i].end = match[i].rm_eo == -1 ? EPOS : pos + start + (size_t)(cur - buf) + match[i].rm_eo;
+			}
+			/* make progress even if the regex matches the empty string */
+			cur += match[0].rm_eo > 0 ? match[0].rm_eo : 1;
+			if (cur > buf + n)
+				break;
+		}
+		if (ret)
+			end = start > 0 ? start + chunk : 0;
+	} while (ret && end > 0 && text_progress(txt, len - end, len));
 	free(buf);
+	if (!ret && pmatch[0].end == pos + end && end < len) {
+		/* the match might continue beyond the chunk, determine its actual end */
+		size_t from = pmatch[0].start;
+		ret = text_search_range_forward(txt, from, pos + len - from, r, nmatch, pmatch,
+		                                eflags | (from > pos ? REG_NOTBOL : 0));
+	}
 	return ret;
 }
 
+size_t text_search_range_matches(Text *txt, size_t pos, size_t len, Regex *r, int eflags,
+	bool (*match)(void *data, RegexMatch*), void *data) {
+	char *buf = malloc(len + 1);
+	if (!buf)
+		return 0;
+	len = text_bytes_get(txt, pos, len, buf);
+	buf[len] = '\0';
+	regmatch_t m[1];
+	size_t count = 0;
+	for (char *cur = buf; cur <= buf + len; ) {
+		if (regexec(&r->regex, cur, 1, m, eflags | (cur > buf ? REG_NOTBOL : 0)))
+			break;
+		if (m[0].rm_so == m[0].rm_eo) {
+			/* ignore empty matches, they can not be displayed anyway */
+			cur += m[0].rm_eo + 1;
+			continue;
+		}
+		RegexMatch found = {
+			.start = pos + (size_t)(cur - buf) + m[0].rm_so,
+			.end = pos + (size_t)(cur - buf) + m[0].rm_eo,
+		};
+		count++;
+		if (!match(data, &found))
+			break;
+		cur += m[0].rm_eo;
+	}
+	free(buf);
+	return count;
+}
+
+static void text_changed(Text *txt, size_t pos, size_t deleted, size_t inserted) {
+	txt->revision++;
+	index_change(txt, pos, deleted, inserted);
+	recovery_record(txt, pos, deleted, inserted);
+}
+
+/* upper bound for the number of bytes scanned to find line boundaries */
+#define INDEX_LINE_MAX (1 << 16)
+
+/* position of the line begin at or before pos, scanning at most INDEX_LINE_MAX bytes */
+static size_t index_line_begin(Text *txt, size_t pos) {
+	char c;
+	Iterator it = text_iterator_get(txt, pos);
+	for (size_t n = 0; n < INDEX_LINE_MAX && text_iterator_byte_prev(&it, &c); n++) {
+		if (c == '\n')
+			return it.pos + 1;
+	}
+	return it.pos;
+}
+
+/* position after the next new line at or after pos, scanning at most max bytes */
+static size_t index_line_end(Text *txt, size_t pos, size_t max) {
+	text_iterate(txt, it, pos) {
+		size_t n = MIN(max, (size_t)(it.end - it.text));
+		const char *nl = memchr(it.text, '\n', n);
+		if (nl)
+			return pos + (nl - it.text) + 1;
+		pos += n;
+		max -= n;
+		if (max == 0)
+			break;
+	}
+	return MIN(pos, txt->size);
+}
+
+/* index of the first match which starts at or after pos */
+static size_t index_find(MatchIndex *idx, size_t pos) {
+	size_t lo = 0, hi = idx->count;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (idx->matches[mid].start < pos)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/* remove all matches which overlap with [start, end) */
+static void index_remove(MatchIndex *idx, size_t start, size_t end) {
+	size_t i = index_find(idx, start), j = index_find(idx, end);
+	if (i > 0 && idx->matches[i-1].end > start)
+		i--;
+	memmove(idx->matches + i, idx->matches + j, (idx->count - j) * sizeof *idx->matches);
+	idx->count -= j - i;
+}
+
+/* insert count matches which all lie in between existing ones */
+static bool index_insert(MatchIndex *idx, RegexMatch *matches, size_t count) {
+	if (count == 0)
+		return true;
+	if (idx->count + count > idx->size) {
+		size_t size = MAX(idx->count + count, 2*idx->size);
+		RegexMatch *m = realloc(idx->matches, size * sizeof *m);
+		if (!m)
+			return false;
+		idx->matches = m;
+		idx->size = size;
+	}
+	size_t i = index_find(idx, matches[0].start);
+	memmove(idx->matches + i + count, idx->matches + i, (idx->count - i) * sizeof *idx->matches);
+	memcpy(idx->matches + i, matches, count * sizeof *matches);
+	idx->count += count;
+	return true;
+}
+
+/* adjust the match index after [pos, pos+deleted) was replaced by inserted bytes,
+ * the affected lines have to be rescanned, all following matches are moved */
+static void index_change(Text *txt, size_t pos, size_t deleted, size_t inserted) {
+	MatchIndex *idx = &txt->matches;
+	if (!idx->regex)
+		return;
+	size_t start = index_line_begin(txt, pos);
+	size_t end = index_line_end(txt, pos + inserted, INDEX_LINE_MAX);
+	size_t end_old = end - inserted + deleted;
+
+	index_remove(idx, start, end_old);
+	for (size_t i = index_find(idx, end_old); i < idx->count; i++) {
+		idx->matches[i].start = idx->matches[i].start - deleted + inserted;
+		idx->matches[i].end = idx->matches[i].end - deleted + inserted;
+	}
+
+	Filerange dirty = { .start = start, .end = end };
+	if (text_range_valid(&idx->dirty)) {
+		Filerange *d = &idx->dirty;
+		if (d->start >= pos + deleted)
+			d->start = d->start - deleted + inserted;
+		else if (d->start > pos)
+			d->start = pos;
+		if (d->end >= pos + deleted)
+			d->end = d->end - deleted + inserted;
+		else if (d->end > pos)
+			d->end = pos + inserted;
+		dirty = text_range_union(&dirty, d);
+		/* matches in between the two regions will be found again */
+		index_remove(idx, dirty.start, dirty.end);
+	}
+	idx->dirty = dirty;
+}
+
+void text_search_index(Text *txt, Regex *r) {
+	MatchIndex *idx = &txt->matches;
+	if (idx->regex == r && (!r || idx->generation == r->generation))
+		return;
+	idx->regex = r;
+	idx->generation = r ? r->generation : 0;
+	idx->count = 0;
+	idx->failed = false;
+	idx->dirty = r ? (Filerange){ .start = 0, .end = txt->size } : text_range_empty();
+}
+
+typedef struct {
+	RegexMatch *matches;
+	size_t count, size;
+	bool failed;            /* whether not all matches could be stored */
+} MatchList;
+
+static bool index_collect(void *data, RegexMatch *match) {
+	MatchList *list = data;
+	if (list->count == list->size) {
+		size_t size = list->size ? 2*list->size : 64;
+		RegexMatch *m = realloc(list->matches, size * sizeof *m);
+		if (!m) {
+			list->failed = true;
+			return false;
+		}
+		list->matches = m;
+		list->size = size;
+	}
+	list->matches[list->count++] = *match;
+	return true;
+}
+
+bool text_search_index_update(Text *txt, size_t len) {
+	MatchIndex *idx = &txt->matches;
+	if (!idx->regex)
+		return false;
+	if (idx->generation != idx->regex->generation) {
+		Regex *r = idx->regex;
+		idx->regex = NULL;
+		text_search_index(txt, r);
+	}
+	if (!text_range_valid(&idx->dirty) || idx->failed)
+		return false;
+	size_t start = idx->dirty.start, end = idx->dirty.end;
+	if (end - start > len) {
+		/* stop at a line boundary to not split any matches */
+		end = index_line_end(txt, start + len, MIN(len, end - start - len));
+	}
+	/* the next chunk is read ahead while this one is searched */
+	if (end < idx->dirty.end)
+		text_advise(txt, end, MIN(len, idx->dirty.end - end), TEXT_ADVICE_WILLNEED);
+	/* scan like text_search_forward which searches from its start position
+	 * without REG_NOTBOL, such that anchored patterns are treated alike */
+	MatchList list = { 0 };
+	text_search_range_matches(txt, start, end - start, idx->regex, 0, index_collect, &list);
+	idx->failed = list.failed || !index_insert(idx, list.matches, list.count);
+	free(list.matches);
+	if (idx->failed)
+		return false;
+	if (end >= idx->dirty.end)
+		idx->dirty = text_range_empty();
+	else
+		idx->dirty.start = end;
+	return text_range_valid(&idx->dirty);
+}
+
+static bool index_complete(MatchIndex *idx, Regex *r) {
+	return idx->regex && (!r || idx->regex == r) &&
+	       idx->generation == idx->regex->generation &&
+	       !text_range_valid(&idx->dirty);
+}
+
+size_t text_search_index_next(Text *txt, size_t pos, Regex *r) {
+	MatchIndex *idx = &txt->matches;
+	if (!index_complete(idx, r))
+		return EPOS;
+	if (idx->count == 0)
+		return pos;
+	size_t i = index_find(idx, pos + 1);
+	return idx->matches[i < idx->count ? i : 0].start;
+}
+
+size_t text_search_index_prev(Text *txt, size_t pos, Regex *r) {
+	MatchIndex *idx = &txt->matches;
+	if (!index_complete(idx, r))
+		return EPOS;
+	if (idx->count == 0)
+		return pos;
+	size_t i = index_find(idx, pos);
+	return idx->matches[i > 0 ? i - 1 : idx->count - 1].start;
+}
+
+bool text_search_index_count(Text *txt, size_t pos, size_t *index, size_t *count) {
+	MatchIndex *idx = &txt->matches;
+	if (!index_complete(idx, NULL))
+		return false;
+	*index = index_find(idx, pos + 1);
+	*count = idx->count;
+	return true;
+}
+
 bool text_range_valid(Filerange *r) {
 	return r->start != EPOS && r->end != EPOS && r->start <= r->end;
 }
@@ -34,7 +34,17 @@ typedef struct {
 	     text_iterator_next(&it))
 
 Text *text_load(const char *file);
+/* the returned text is initially empty, its content is read incrementally
+ * by text_load_more. until EOF is reached the text can not be modified. */
 Text *text_load_fd(int fd);
+/* append up to len bytes read from the fd passed to text_load_fd. stops early
+ * if less data than requested is currently available, without blocking only
+ * if the fd is in non-blocking mode (O_NONBLOCK). returns the number of bytes
+ * read, 0 at EOF or -1 on error in which case loading is aborted unless errno
+ * is EAGAIN */
+ssize_t text_load_more(Text*, size_t len);
+/* whether text_load_more has yet to reach EOF */
+bool text_loading(Text*);
 /* return the fd from which this text was loaded or -1 if it was
  * loaded from a filename */
 int text_fd_get(Text*);
@@ -42,13 +52,89 @@ int text_fd_get(Text*);
 const char *text_filename_get(Text*);
 /* associate a filename with the yet unnamed buffer */
 void text_filename_set(Text*, const char *filename);
+/* register a function which is periodically called with the number of processed
+ * and total bytes during long running operations like searches or saves. if it
+ * returns false the operation is aborted, a search then reports no match and a
+ * save fails. pass NULL to unregister. */
+void text_progress_set(Text*, bool (*progress)(void *data, size_t done, size_t total), void *data);
+/* once the buffers holding inserted data occupy more than limit bytes of heap
+ * memory, new ones are backed by unlinked files in $TMPDIR (default /var/tmp)
+ * such that they can be paged out. 0, the default, disables the limit. */
+void text_heap_limit_set(Text*, size_t limit);
+/* number of bytes of heap memory currently allocated to hold inserted data */
+size_t text_heap_size(Text*);
+/* keep the undo history in dir once the text is freed, provided that its content
+ * was saved to its file. it is restored once needed (e.g. upon the first undo)
+ * if the file was not changed in the meantime. NULL, the default, disables this. */
+void text_history_dir_set(Text*, const char *dir);
+/* cache the line index of large files in dir, such that the line number based
+ * navigation of an unchanged file is fast right after it is loaded. dir is
+ * created once the first index is stored. NULL, the default, keeps the index
+ * only in memory. unless a cached index is found, the lines are then counted
+ * in the background, otherwise this only happens once they are needed. */
+void text_lineindex_dir_set(Text*, const char *dir);
+/* record all modifications in `filename~recover' until the text is saved to
+ * its file. the records are buffered and written by text_recovery_flush or once
+ * enough of them accumulated. the journal is removed when the text is freed.
+ * one of a previous session is kept until text_recover or text_recovery_discard
+ * is called, the records are meanwhile written to `filename~recover.new'. */
+void text_recovery_set(Text*, bool enable);
+bool text_recovery_flush(Text*);
+/* whether there are recorded modifications which were not yet written */
+bool text_recovery_pending(Text*);
+/* write all pending records and stop recording, the journal is then kept */
+void text_recovery_keep(Text*);
+/* whether a journal of a previous session applies to the unmodified text */
+bool text_recovery_available(Text*);
+/* replay the journal as one action and continue recording to it */
+bool text_recover(Text*);
+/* remove the journal of a previous session without applying it */
+void text_recovery_discard(Text*);
+/* expected access to (a range of) the text, passed on to the kernel as a hint
+ * for the parts which refer to the mapped content of the loaded file or to
+ * inserted data kept in temporary files */
+enum TextAdvice {
+	TEXT_ADVICE_NORMAL,      /* no particular pattern, the default */
+	TEXT_ADVICE_SEQUENTIAL,  /* read once from start to end */
+	TEXT_ADVICE_WILLNEED,    /* read soon, it should be read ahead */
+	TEXT_ADVICE_COLD,        /* not needed in the near future, it may be evicted */
+};
+
+void text_advise(Text*, size_t pos, size_t len, enum TextAdvice);
+/* move the data held in heap memory to unlinked temporary files (see
+ * text_heap_limit_set) and let the kernel page out all mapped data. the data
+ * is transparently read back once accessed, marks remain valid. returns the
+ * number of bytes of heap memory which were released. */
+size_t text_evict(Text*);
 bool text_insert(Text*, size_t pos, const char *data, size_t len);
+/* insert the content of the given file at pos, the file is mmap(2)-ed and
+ * referred to by a single piece, hence its data is never copied */
+bool text_insert_file(Text*, size_t pos, const char *filename);
+/* append the data which was added to the file since it was loaded (or last
+ * followed) as one action, the existing content is not read again. if the text
+ * was unmodified it remains so. returns the number of appended bytes or -1 on
+ * error, in particular if the file was truncated (errno is then ERANGE). */
+ssize_t text_follow(Text*);
+/* replace the content by the current one of the file as one action, only the
+ * lines which differ are changed. marks outside of them remain valid and the
+ * text is considered unmodified afterwards. fails with errno set to ERANGE if
+ * the mapped file was truncated in place, the text then has to be loaded anew. */
+bool text_reload(Text*);
+/* whether the file was changed by another program since the text was loaded
+ * from or last saved to it */
+bool text_file_changed(Text*);
+/* whether filename refers to the same file (by device and inode number) as
+ * the one the text was loaded from or last saved to */
+bool text_file_same(Text*, const char *filename);
 bool text_delete(Text*, size_t pos, size_t len);
 void text_snapshot(Text*);
 /* undo/redos to the last snapshoted state. returns the position where
  * the change occured or EPOS if nothing could be undo/redo. */
 size_t text_undo(Text*);
 size_t text_redo(Text*);
+/* like text_undo but only for modifications performed since the last snapshot,
+ * they are discarded and can not be redone */
+size_t text_revert(Text*);
 
 size_t text_pos_by_lineno(Text*, size_t lineno);
 size_t text_lineno_by_pos(Text*, size_t pos);
@@ -82,6 +168,9 @@ size_t text_history_get(Text*, size_t index);
 
 size_t text_size(Text*);
 bool text_modified(Text*);
+/* a counter which is incremented whenever the text content changes, it can be
+ * used to detect whether information derived from the text became stale */
+size_t text_revision(Text*);
 
 /* which type of new lines does the text use? */
 enum TextNewLine {
@@ -93,8 +182,42 @@ enum TextNewLine text_newline_type(Text*);
 
 bool text_save(Text*, const char *file);
 bool text_range_save(Text*, Filerange*, const char *file);
+/* start saving the range in a background thread. the text can be modified
+ * meanwhile, the state at the time of the call is saved. only one background
+ * save can be in progress, other saves wait for it to complete. */
+bool text_range_save_start(Text*, Filerange*, const char *file);
+/* a file descriptor which becomes readable once the background save is done
+ * and text_save_finish should be called, -1 if no save is in progress */
+int text_save_fd(Text*);
+/* get the number of written and total bytes of the background save, returns
+ * false if none is in progress */
+bool text_save_progress(Text*, size_t *done, size_t *total);
+/* wait for the background save to complete. returns whether it succeeded,
+ * if so the text is considered unmodified unless it was changed meanwhile */
+bool text_save_finish(Text*);
+/* save the whole text to the file it was loaded from by overwriting only the
+ * modified region, provided that it is small compared to the file size and the
+ * file was not changed externally. otherwise behaves like text_save. the
+ * original content of the overwritten region is kept in a journal `file~journal'
+ * which remains if the save did not complete. */
+bool text_save_inplace(Text*, const char *file);
+/* whether such a journal was found when the text was loaded, the file is then
+ * possibly inconsistent */
+bool text_journal_available(Text*);
+/* write the original content kept in the journal back to the unmodified file
+ * and remove the journal. the text has to be reloaded afterwards */
+bool text_journal_restore(Text*);
+/* remove the journal without applying it, saving the whole text to the
+ * file also does so */
+void text_journal_discard(Text*);
 ssize_t text_write(Text*, int fd);
 ssize_t text_range_write(Text*, Filerange*, int fd);
+/* after the text was completely saved to its file, refer to the file content
+ * by a single piece instead of the data the text was built from. the undo
+ * history is either kept (redo is discarded) or, if history is false, dropped.
+ * buffers which are no longer referenced are released and all marks become
+ * invalid. returns false if the file does not correspond to the text. */
+bool text_rebase(Text*, bool history);
 void text_free(Text*);
 
 typedef struct Regex Regex;
@@ -105,6 +228,26 @@ int text_regex_compile(Regex *r, const char *regex, int cflags);
 void text_regex_free(Regex *r);
 int text_search_range_forward(Text*, size_t pos, size_t len, Regex *r, size_t nmatch, RegexMatch pmatch[], int eflags);
 int text_search_range_backward(Text*, size_t pos, size_t len, Regex *r, size_t nmatch, RegexMatch pmatch[], int eflags);
+/* call match for all non-empty, non overlapping matches of r within [pos, pos+len)
+ * in ascending order until it returns false. returns the number of matches found */
+size_t text_search_range_matches(Text*, size_t pos, size_t len, Regex *r, int eflags,
+	bool (*match)(void *data, RegexMatch*), void *data);
+/* maintain a sorted index of all matches of r (or none if NULL). the index is
+ * built incrementally by text_search_index_update, modifications of the text
+ * only invalidate the affected lines. */
+void text_search_index(Text*, Regex *r);
+/* scan at most (roughly) len bytes of the not yet indexed text, returns
+ * whether further work is pending. if memory runs out the index is left
+ * incomplete and no further work is done until another regex is indexed. */
+bool text_search_index_update(Text*, size_t len);
+/* get the start of the next/previous indexed match of r relative to pos,
+ * wrapping around at the end/start of the file. returns pos if there is
+ * no match at all and EPOS if no complete index for r exists. */
+size_t text_search_index_next(Text*, size_t pos, Regex *r);
+size_t text_search_index_prev(Text*, size_t pos, Regex *r);
+/* if the index is complete, store the total number of matches in count
+ * and the number of matches which start at or before pos in index */
+bool text_search_index_count(Text*, size_t pos, size_t *index, size_t *count);
 
 // TMP
 void text_debug(Text*);
@@ -162,7 +162,7 @@ static void ui_window_move(UiCursesWin *win, int x, int y) {
 
 static void ui_window_draw_status(UiWin *w) {
 	UiCursesWin *win = (UiCursesWin*)w;
-	if (!win->winstatus)
+	if (!win->winstatus || !win->width)
 		return;
 	UiCurses *uic = win->ui;
 	Editor *vis = uic->ed;
@@ -171,13 +171,23 @@ static void ui_window_draw_status(UiWin *w) {
 	CursorPos pos = view_cursor_getpos(win->view);
 	wattrset(win->winstatus, focused ? A_REVERSE|A_BOLD : A_REVERSE);
 	mvwhline(win->winstatus, 0, 0, ' ', win->width);
-	mvwprintw(win->winstatus, 0, 0, "%s %s %s %s",
+	char saving[32] = "";
+	size_t done, total;
+	if (text_save_progress(win->text, &done, &total))
+		snprintf(saving, sizeof saving, "[saving %d%%]", total ? (int)(100.0 * done / total) : 0);
+	mvwprintw(win->winstatus, 0, 0, "%s %s %s %s%s %s",
 	          vis->mode->name && vis->mode->name[0] == '-' ? vis->mode->name : "",
 	          filename ? filename : "[No Name]",
-	          text_modified(win->text) ? "[+]" : "",
-	          vis->recording ? "recording": "");
+	          text_loading(win->text) ? "[loading]" : text_modified(win->text) ? "[+]" : "",
+	          win->options & UI_OPTION_LARGE_FILE ? "[large]" : "",
+	          saving, vis->recording ? "recording": "");
 	char buf[win->width + 1];
-	int len = snprintf(buf, win->width, "%zd, %zd", pos.line, pos.col);
+	size_t match, matches;
+	int len;
+	if (text_search_index_count(win->text, view_cursor_get(win->view), &match, &matches))
+		len = snprintf(buf, win->width, "[%zu/%zu] %zd, %zd", match, matches, pos.line, pos.col);
+	else
+		len = snprintf(buf, win->width, "%zd, %zd", pos.line, pos.col);
 	if (len > 0) {
 		buf[len] = '\0';
 		mvwaddstr(win->winstatus, 0, win->width - len - 1, buf);
@@ -397,19 +407,13 @@ static void ui_window_focus(UiWin *w) {
 static void ui_window_options(UiWin *w, enum UiOption options) {
 	UiCursesWin *win = (UiCursesWin*)w;
 	win->options = options;
-	switch (options) {
-	case UI_OPTION_LINE_NUMBERS_NONE:
-		if (win->winside) {
-			delwin(win->winside);
-			win->winside = NULL;
-			win->sidebar_width = 0;
-		}
-		break;
-	case UI_OPTION_LINE_NUMBERS_ABSOLUTE:
-	case UI_OPTION_LINE_NUMBERS_RELATIVE:
+	if (options & (UI_OPTION_LINE_NUMBERS_ABSOLUTE|UI_OPTION_LINE_NUMBERS_RELATIVE)) {
 		if (!win->winside)
 			win->winside = newwin(1, 1, 1, 1);
-		break;
+	} else if (win->winside) {
+		delwin(win->winside);
+		win->winside = NULL;
+		win->sidebar_width = 0;
 	}
 	ui_window_draw(w);
 }
@@ -429,7 +433,9 @@ static UiWin *ui_window_new(Ui *ui, View *view, Text *text) {
 		.reload = ui_window_reload,
 	};
 
-	if (!(win->win = newwin(0, 0, 0, 0)) || !(win->winstatus = newwin(1, 0, 0, 0))) {
+	/* the real size is only known once the window is arranged, do not
+	 * allocate screen sized buffers for windows which are never shown */
+	if (!(win->win = newwin(1, 0, 0, 0)) || !(win->winstatus = newwin(1, 0, 0, 0))) {
 		ui_window_free((UiWin*)win);
 		return NULL;
 	}
@@ -13,6 +13,7 @@ enum UiOption {
 	UI_OPTION_LINE_NUMBERS_NONE = 0,
 	UI_OPTION_LINE_NUMBERS_ABSOLUTE = 1 << 0,
 	UI_OPTION_LINE_NUMBERS_RELATIVE = 1 << 1,
+	UI_OPTION_LARGE_FILE = 1 << 2,
 };
 
 #include <stdbool.h>
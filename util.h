@@ -1,6 +1,10 @@
 #ifndef UTIL_H
 #define UTIL_H
 
+#include <stdbool.h>
+#include <errno.h>
+#include <sys/stat.h>
+
 #define LENGTH(x)  ((int)(sizeof (x) / sizeof *(x)))
 #define MIN(a, b)  ((a) > (b) ? (b) : (a))
 #define MAX(a, b)  ((a) < (b) ? (b) : (a))
@@ -9,4 +13,18 @@
 #define ISUTF8(c)   (((c)&0xC0)!=0x80)
 #define ISASCII(ch) ((unsigned char)ch < 0x80)
 
+/* create the directory including all missing parents */
+static inline bool mkdirs(char *path) {
+	for (char *s = path + 1; *s; s++) {
+		if (*s != '/')
+			continue;
+		*s = '\0';
+		bool ok = mkdir(path, 0700) == 0 || errno == EEXIST;
+		*s = '/';
+		if (!ok)
+			return false;
+	}
+	return mkdir(path, 0700) == 0 || errno == EEXIST;
+}
+
 #endif
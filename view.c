@@ -35,6 +35,14 @@ typedef struct {            /* cursor position */
 	bool highlighted;   /* true e.g. when cursor is on a bracket */
 } Cursor;
 
+typedef struct {            /* matches of the search pattern around the viewport */
+	RegexMatch *matches;  /* sorted array of non overlapping matches */
+	size_t count;         /* number of matches currently stored */
+	size_t size;          /* number of allocated array elements */
+	Filerange range;      /* area which was searched, invalid if nothing is cached */
+	size_t revision;      /* text revision at the time of the search */
+} Highlight;
+
 struct View {               /* viewable area, showing part of a file */
 	Text *text;         /* underlying text management */
 	UiWin *ui;
@@ -52,6 +60,8 @@ struct View {               /* viewable area, showing part of a file */
 	int col;            /* used while drawing view content, column where next char will be drawn */
 	Syntax *syntax;     /* syntax highlighting definitions for this view or NULL */
 	int tabwidth;       /* how many spaces should be used to display a tab character */
+	Regex *search;      /* pattern whose matches should be highlighted or NULL */
+	Highlight highlight;/* cached matches of the search pattern */
 };
 
 static void view_clear(View *view);
@@ -133,6 +143,13 @@ Filerange view_viewport_get(View *view) {
 	return (Filerange){ .start = view->start, .end = view->end };
 }
 
+void view_viewport_set(View *view, size_t start, size_t pos) {
+	size_t max = text_size(view->text);
+	view->start = start > max ? max : start;
+	view_draw(view);
+	view_cursor_to(view, pos);
+}
+
 /* try to add another character to the view, return whether there was space left */
 static bool view_addch(View *view, Cell *cell) {
 	if (!view->line)
@@ -278,7 +295,9 @@ static size_t view_cursor_update(View *view) {
 		view_draw(view);
 	} else if (view->ui && view->syntax) {
 		size_t pos = cursor->pos;
-		size_t pos_match = text_bracket_match_except(view->text, pos, "<>");
+		/* only a visible match is highlighted, do not search beyond */
+		Filerange visible = view_viewport_get(view);
+		size_t pos_match = text_bracket_match_range(view->text, pos, "<>", &visible);
 		if (pos != pos_match && view->start <= pos_match && pos_match < view->end) {
 			if (cursor->highlighted)
 				view_draw(view); /* clear active highlighting */
@@ -330,6 +349,40 @@ void view_cursor_to(View *view, size_t pos) {
 	view_cursor_update(view);
 }
 
+static bool view_highlight_add(void *data, RegexMatch *match) {
+	Highlight *hl = data;
+	if (hl->count == hl->size) {
+		size_t size = hl->size ? 2*hl->size : 64;
+		RegexMatch *matches = realloc(hl->matches, size * sizeof *matches);
+		if (!matches)
+			return false;
+		hl->matches = matches;
+		hl->size = size;
+	}
+	hl->matches[hl->count++] = *match;
+	return true;
+}
+
+/* make sure the matches of the search pattern within [start, end) are cached.
+ * the regex is only evaluated if the text changed or the area is not covered
+ * by the last search, in which case one screen worth of data before and after
+ * the requested area is searched too. this way cursor movements and scrolling
+ * by small amounts do not trigger a new search. */
+static void view_highlight_update(View *view, size_t start, size_t end) {
+	Highlight *hl = &view->highlight;
+	size_t revision = text_revision(view->text);
+	if (text_range_valid(&hl->range) && hl->revision == revision &&
+	    hl->range.start <= start && end <= hl->range.end)
+		return;
+	size_t margin = end - start;
+	hl->range.start = start > margin ? start - margin : 0;
+	hl->range.end = MIN(end + margin, text_size(view->text));
+	hl->revision = revision;
+	hl->count = 0;
+	text_search_range_matches(view->text, hl->range.start, text_range_size(&hl->range),
+		view->search, hl->range.start > 0 ? REG_NOTBOL : 0, view_highlight_add, hl);
+}
+
 /* redraw the complete with data starting from view->start bytes into the file.
  * stop once the screen is full, update view->end, view->lastline */
 void view_draw(View *view) {
@@ -355,6 +408,13 @@ void view_draw(View *view) {
 	memset(match, 0, sizeof match);
 	/* default and current curses attributes to use */
 	int default_attrs = COLOR_PAIR(0) | A_NORMAL, attrs = default_attrs;
+	/* matches of the search pattern which should be highlighted */
+	Highlight *hl = &view->highlight;
+	size_t hl_index = 0;
+	if (view->search)
+		view_highlight_update(view, pos, MIN(pos + text_len, text_size(view->text)));
+	else
+		hl->count = 0;
 
 	while (rem > 0) {
 
@@ -445,6 +505,10 @@ void view_draw(View *view) {
 		}
 
 		cell.attr = attrs;
+		while (hl_index < hl->count && hl->matches[hl_index].end <= pos)
+			hl_index++;
+		if (hl_index < hl->count && hl->matches[hl_index].start <= pos)
+			cell.attr |= A_UNDERLINE;
 		if (sel.start <= pos && pos < sel.end)
 			cell.attr |= A_REVERSE;
 		if (!view_addch(view, &cell))
@@ -467,7 +531,11 @@ void view_draw(View *view) {
 }
 
 bool view_resize(View *view, int width, int height) {
-	size_t lines_size = height*(sizeof(Line) + width*sizeof(Cell));
+	/* a window without any room has a height of zero, there is
+	 * nevertheless always one line to lay out the text */
+	if (height < 0)
+		height = 0;
+	size_t lines_size = MAX(height, 1)*(sizeof(Line) + width*sizeof(Cell));
 	if (lines_size > view->lines_size) {
 		Line *lines = realloc(view->lines, lines_size);
 		if (!lines)
@@ -491,11 +559,13 @@ void view_free(View *view) {
 	if (!view)
 		return;
 	free(view->lines);
+	free(view->highlight.matches);
 	free(view);
 }
 
 void view_reload(View *view, Text *text) {
 	view->text = text;
+	view->highlight.range = text_range_empty();
 	view_selection_clear(view);
 	view_cursor_to(view, 0);
 	if (view->ui)
@@ -511,6 +581,7 @@ View *view_new(Text *text, ViewEvent *events) {
 	view->text = text;
 	view->events = events;
 	view->tabwidth = 8;
+	view->highlight.range = text_range_empty();
 	
 	if (!view_resize(view, 1, 1)) {
 		view_free(view);
@@ -869,7 +940,7 @@ const Line *view_lines_get(View *view) {
 
 void view_scroll_to(View *view, size_t pos) {
 	while (pos < view->start && view_viewport_up(view, 1));
-	while (pos > view->end && view_viewport_down(view, 1));
+	while (pos >= view->end && view_viewport_down(view, 1));
 	view_cursor_to(view, pos);
 }
 
@@ -882,14 +953,42 @@ void view_selection_start(View *view) {
 	view_cursor_to(view, pos);
 }
 
-void view_syntax_set(View *view, Syntax *syntax) {
+static bool syntax_compile(Syntax *syntax) {
+	if (syntax->compiled)
+		return true;
+	for (int i = 0; i < LENGTH(syntax->rules); i++) {
+		SyntaxRule *rule = &syntax->rules[i];
+		if (!rule->rule)
+			break;
+		int cflags = REG_EXTENDED;
+		if (!rule->multiline)
+			cflags |= REG_NEWLINE;
+		if (regcomp(&rule->regex, rule->rule, cflags)) {
+			while (--i >= 0)
+				regfree(&syntax->rules[i].regex);
+			return false;
+		}
+	}
+	syntax->compiled = true;
+	return true;
+}
+
+bool view_syntax_set(View *view, Syntax *syntax) {
+	if (syntax && !syntax_compile(syntax))
+		return false;
 	view->syntax = syntax;
+	return true;
 }
 
 Syntax *view_syntax_get(View *view) {
 	return view->syntax;
 }
 
+void view_search_set(View *view, Regex *regex) {
+	view->search = regex;
+	view->highlight.range = text_range_empty();
+}
+
 size_t view_screenline_goto(View *view, int n) {
 	size_t pos = view->start;
 	for (Line *line = view->topline; --n > 0 && line != view->lastline; line = line->next)
@@ -108,8 +108,15 @@ void view_selection_set(View*, Filerange *sel);
 void view_selection_clear(View*);
 /* get the currently displayed area in bytes from the start of the file */
 Filerange view_viewport_get(View*);
-/* associate a set of syntax highlighting rules to this window. */
-void view_syntax_set(View*, Syntax*);
+/* display text starting from byte position start and place the cursor at pos,
+ * used to restore a previously saved state obtained by view_viewport_get */
+void view_viewport_set(View*, size_t start, size_t pos);
+/* associate a set of syntax highlighting rules to this window, they are compiled
+ * upon first use. returns false if this fails, the window is then left unchanged. */
+bool view_syntax_set(View*, Syntax*);
 Syntax *view_syntax_get(View*);
+/* highlight all matches of the given regex or disable highlighting if NULL.
+ * has to be called again whenever the regex is recompiled. */
+void view_search_set(View*, Regex*);
 
 #endif
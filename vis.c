@@ -25,6 +25,9 @@
 #include <fcntl.h>
 #include <limits.h>
 #include <ctype.h>
+#include <time.h>
+#include <termios.h>
+#include <wordexp.h>
 #include <sys/select.h>
 #include <sys/types.h>
 #include <sys/wait.h>
@@ -42,6 +45,18 @@
 /** global variables */
 static Editor *vis;         /* global editor instance, keeps track of all windows etc. */
 
+static struct {             /* state of the search performed while a pattern is typed */
+	Win *win;           /* window being searched or NULL if no search is active */
+	Regex *regex;       /* pattern currently entered at the prompt, not in the regex cache */
+	char *pattern;      /* its source, referenced by regex */
+	size_t revision;    /* prompt text revision the regex was compiled from */
+	Filerange viewport; /* displayed area before the prompt was shown */
+	size_t cursor;      /* cursor position before the prompt was shown */
+	size_t pos;         /* where the next chunk of the scan starts (ends if backwards) */
+	size_t scanned;     /* number of bytes scanned so far */
+	bool pending;       /* whether the scan is still in progress */
+} isearch;
+
 /** operators */
 static size_t op_change(OperatorContext *c);
 static size_t op_yank(OperatorContext *c);
@@ -84,6 +99,22 @@ static Operator ops[] = {
 #define PAGE      INT_MAX
 #define PAGE_HALF (INT_MAX-1)
 
+/* number of bytes processed by a background work step while idle */
+#define BACKGROUND_CHUNK_SIZE (1 << 20)
+
+/* writes of at least this many bytes are performed by a background thread */
+#define BACKGROUND_SAVE_SIZE (1 << 24)
+
+/* time in milliseconds after which a long running operation displays its
+ * progress and can be cancelled, and the interval between updates */
+#define PROGRESS_DELAY  250
+#define PROGRESS_UPDATE 100
+
+/* recorded modifications are written to the recovery journals once no key was
+ * pressed for RECOVERY_IDLE seconds, while typing every RECOVERY_INTERVAL seconds */
+#define RECOVERY_IDLE     1
+#define RECOVERY_INTERVAL 5
+
 /* these can be passed as int argument to movement(&(const Arg){ .i = MOVE_* }) */
 enum {
 	MOVE_LINE_DOWN,
@@ -361,6 +392,8 @@ static void prompt_up(const Arg *arg);
 static void prompt_down(const Arg *arg);
 /* exit command mode if the last char is deleted */
 static void prompt_backspace(const Arg *arg);
+/* abort the incremental search, restore viewport and cursor position */
+static void isearch_stop(void);
 /* blocks to read 3 consecutive digits and inserts the corresponding byte value */
 static void insert_verbatim(const Arg *arg);
 /* scroll window content according to arg->i which can be either PAGE, PAGE_HALF,
@@ -392,6 +425,8 @@ static bool cmd_bdelete(Filerange*, enum CmdOpt, const char *argv[]);
 static bool cmd_qall(Filerange*, enum CmdOpt, const char *argv[]);
 /* for each argument try to insert the file content at current cursor postion */
 static bool cmd_read(Filerange*, enum CmdOpt, const char *argv[]);
+/* apply the modifications recorded before the editor exited abnormally */
+static bool cmd_recover(Filerange*, enum CmdOpt, const char *argv[]);
 static bool cmd_substitute(Filerange*, enum CmdOpt, const char *argv[]);
 /* if no argument are given, split the current window horizontally,
  * otherwise open the file */
@@ -428,6 +463,115 @@ static Key getkey(void);
 static void keypress(Key *key);
 static void action_do(Action *a);
 static bool exec_command(char type, const char *cmdline);
+static void follow_step(void);
+
+/** progress reporting and cancellation of long running operations */
+
+static struct {
+	int depth;             /* nesting level of progress_start calls */
+	Text *text;            /* text being operated on */
+	const char *what;      /* user facing description of the operation */
+	size_t revision;       /* text revision at the start of the operation */
+	struct timespec start; /* when the operation was started */
+	struct timespec shown; /* when the progress was last displayed */
+	bool interruptible;    /* whether CTRL-C currently raises SIGINT */
+	bool visible;          /* whether the progress is being displayed */
+	bool restore_term;     /* whether term holds the terminal settings to restore */
+	struct termios term;
+	struct sigaction sa;   /* previous SIGINT handler */
+} progress;
+
+static long progress_elapsed(struct timespec *since) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - since->tv_sec) * 1000 + (now.tv_nsec - since->tv_nsec) / 1000000;
+}
+
+static void cancel(int sig) {
+	vis->cancelled = true;
+}
+
+/* let CTRL-C raise SIGINT, which is otherwise disabled by the raw terminal mode */
+static void progress_interruptible(void) {
+	if (progress.interruptible)
+		return;
+	struct sigaction sa;
+	sa.sa_flags = 0;
+	sigemptyset(&sa.sa_mask);
+	sa.sa_handler = cancel;
+	if (sigaction(SIGINT, &sa, &progress.sa) == -1)
+		return;
+	progress.interruptible = true;
+	progress.restore_term = tcgetattr(STDIN_FILENO, &progress.term) == 0;
+	if (progress.restore_term) {
+		struct termios term = progress.term;
+		term.c_lflag |= ISIG;
+		term.c_cc[VQUIT] = _POSIX_VDISABLE;
+		term.c_cc[VSUSP] = _POSIX_VDISABLE;
+		tcsetattr(STDIN_FILENO, TCSANOW, &term);
+	}
+}
+
+/* checkpoint of a long running operation, displays the progress once the
+ * operation took a noticeable amount of time. returns false if the operation
+ * was cancelled and should be aborted as soon as possible. */
+static bool progress_update(void *data, size_t done, size_t total) {
+	if (vis->cancelled || !progress.depth)
+		return !vis->cancelled;
+	if (!progress.visible) {
+		if (progress_elapsed(&progress.start) < PROGRESS_DELAY)
+			return true;
+		progress_interruptible();
+		progress.visible = true;
+	} else if (progress_elapsed(&progress.shown) < PROGRESS_UPDATE) {
+		return true;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &progress.shown);
+	editor_info_show(vis, "%s %d%% (press CTRL-C to cancel)", progress.what,
+	                 total ? (int)(100.0 * done / total) : 0);
+	editor_update(vis);
+	return !vis->cancelled;
+}
+
+/* mark the start of a possibly long running operation on txt, all text level
+ * operations like searches and saves will report their progress */
+static void progress_start(Text *txt, const char *what) {
+	if (progress.depth++ > 0)
+		return;
+	/* modifications of the operation form an action of their own, such
+	 * that they can be reverted by themselves if it is cancelled */
+	text_snapshot(txt);
+	vis->cancelled = false;
+	progress.text = txt;
+	progress.what = what;
+	progress.revision = text_revision(txt);
+	progress.interruptible = false;
+	progress.visible = false;
+	clock_gettime(CLOCK_MONOTONIC, &progress.start);
+	text_progress_set(txt, progress_update, NULL);
+}
+
+/* returns false if the operation was cancelled, in which case all modifications
+ * performed since progress_start are reverted */
+static bool progress_stop(void) {
+	if (--progress.depth > 0)
+		return !vis->cancelled;
+	text_progress_set(progress.text, NULL, NULL);
+	if (progress.interruptible) {
+		if (progress.restore_term)
+			tcsetattr(STDIN_FILENO, TCSANOW, &progress.term);
+		sigaction(SIGINT, &progress.sa, NULL);
+	}
+	if (!vis->cancelled) {
+		if (progress.visible)
+			editor_info_hide(vis);
+		return true;
+	}
+	if (text_revision(progress.text) != progress.revision)
+		text_revert(progress.text);
+	editor_info_show(vis, "%s cancelled", progress.what);
+	return false;
+}
 
 /** operator implementations of type: void (*op)(OperatorContext*) */
 
@@ -495,7 +639,8 @@ static size_t op_shift_right(OperatorContext *c) {
 		prev_pos = pos = text_line_begin(txt, pos);
 		text_insert(txt, pos, tab, tablen);
 		pos = text_line_prev(txt, pos);
-	}  while (pos >= c->range.start && pos != prev_pos);
+	}  while (pos >= c->range.start && pos != prev_pos &&
+	          progress_update(NULL, c->range.end - pos, text_range_size(&c->range)));
 
 	return c->pos + tablen;
 }
@@ -523,33 +668,41 @@ static size_t op_shift_left(OperatorContext *c) {
 		tablen = MIN(len, tabwidth);
 		text_delete(txt, pos, tablen);
 		pos = text_line_prev(txt, pos);
-	}  while (pos >= c->range.start && pos != prev_pos);
+	}  while (pos >= c->range.start && pos != prev_pos &&
+	          progress_update(NULL, c->range.end - pos, text_range_size(&c->range)));
 
 	return c->pos - tablen;
 }
 
 static size_t op_case_change(OperatorContext *c) {
 	Text *txt = vis->win->file->text;
-	size_t len = c->range.end - c->range.start;
-	char *buf = malloc(len);
+	size_t size = text_range_size(&c->range);
+	/* process large ranges in chunks to be able to report progress */
+	char *buf = malloc(MIN(size, BACKGROUND_CHUNK_SIZE));
 	if (!buf)
 		return c->pos;
-	len = text_bytes_get(txt, c->range.start, len, buf);
-	size_t rem = len;
-	for (char *cur = buf; rem > 0; cur++, rem--) {
-		int ch = (unsigned char)*cur;
-		if (isascii(ch)) {
-			if (c->arg->i == 0)
-				*cur = islower(ch) ? toupper(ch) : tolower(ch);
-			else if (c->arg->i > 0)
-				*cur = toupper(ch);
-			else
-				*cur = tolower(ch);
+	for (size_t pos = c->range.start, len; pos < c->range.end; pos += len) {
+		len = text_bytes_get(txt, pos, MIN(c->range.end - pos, BACKGROUND_CHUNK_SIZE), buf);
+		if (!len)
+			break;
+		size_t rem = len;
+		for (char *cur = buf; rem > 0; cur++, rem--) {
+			int ch = (unsigned char)*cur;
+			if (isascii(ch)) {
+				if (c->arg->i == 0)
+					*cur = islower(ch) ? toupper(ch) : tolower(ch);
+				else if (c->arg->i > 0)
+					*cur = toupper(ch);
+				else
+					*cur = tolower(ch);
+			}
 		}
-	}
 
-	text_delete(txt, c->range.start, len);
-	text_insert(txt, c->range.start, buf, len);
+		text_delete(txt, pos, len);
+		text_insert(txt, pos, buf, len);
+		if (!progress_update(NULL, pos + len - c->range.start, size))
+			break;
+	}
 	free(buf);
 	return c->pos;
 }
@@ -572,7 +725,8 @@ static size_t op_join(OperatorContext *c) {
 		} else {
 			break;
 		}
-	} while (pos != prev_pos);
+	} while (pos != prev_pos &&
+	         progress_update(NULL, c->range.end - pos, text_range_size(&c->range)));
 
 	return c->range.start;
 }
@@ -620,25 +774,32 @@ static char *get_word_at(Text *txt, size_t pos) {
 
 static size_t search_word_forward(Text *txt, size_t pos) {
 	char *word = get_word_at(txt, pos);
-	if (word && !text_regex_compile(vis->search_pattern, word, REG_EXTENDED))
-		pos = text_search_forward(txt, pos, vis->search_pattern);
+	if (word && editor_search_pattern_set(vis, word, REG_EXTENDED))
+		pos = search_forward(txt, pos);
 	free(word);
 	return pos;
 }
 
 static size_t search_word_backward(Text *txt, size_t pos) {
 	char *word = get_word_at(txt, pos);
-	if (word && !text_regex_compile(vis->search_pattern, word, REG_EXTENDED))
-		pos = text_search_backward(txt, pos, vis->search_pattern);
+	if (word && editor_search_pattern_set(vis, word, REG_EXTENDED))
+		pos = search_backward(txt, pos);
 	free(word);
 	return pos;
 }
 
 static size_t search_forward(Text *txt, size_t pos) {
+	if (!vis->search_pattern)
+		return pos;
+	/* (re)start building the match index used by subsequent searches */
+	text_search_index(txt, vis->win->matchcount ? vis->search_pattern : NULL);
 	return text_search_forward(txt, pos, vis->search_pattern);
 }
 
 static size_t search_backward(Text *txt, size_t pos) {
+	if (!vis->search_pattern)
+		return pos;
+	text_search_index(txt, vis->win->matchcount ? vis->search_pattern : NULL);
 	return text_search_backward(txt, pos, vis->search_pattern);
 }
 
@@ -977,8 +1138,85 @@ static void insert_register(const Arg *arg) {
 }
 
 static void prompt_search(const Arg *arg) {
+	Win *win = vis->win;
 	editor_prompt_show(vis, arg->s, "");
 	switchmode(&(const Arg){ .i = VIS_MODE_PROMPT });
+	isearch.win = win;
+	isearch.viewport = view_viewport_get(win->view);
+	isearch.cursor = view_cursor_get(win->view);
+	isearch.revision = text_revision(vis->prompt->file->text);
+	isearch.pending = false;
+}
+
+/* recompile the pattern after the prompt content changed and restart the scan
+ * from the original cursor position, thereby canceling the previous one. the
+ * intermediate patterns would evict useful entries from the regex cache, only
+ * the final one is added to it once the search is executed */
+static void isearch_update(void) {
+	View *view = isearch.win->view;
+	char *s = editor_prompt_get(vis);
+	isearch.revision = text_revision(vis->prompt->file->text);
+	if (s && *s && !isearch.regex)
+		isearch.regex = text_regex_new();
+	isearch.pending = s && *s && isearch.regex && !text_regex_compile(isearch.regex, s, REG_EXTENDED);
+	free(isearch.pattern);
+	isearch.pattern = s;
+	if (!isearch.pending) {
+		view_viewport_set(view, isearch.viewport.start, isearch.cursor);
+		editor_search_highlight(vis, vis->hlsearch);
+		return;
+	}
+	view_search_set(view, isearch.regex);
+	isearch.scanned = 0;
+	isearch.pos = isearch.cursor;
+	if (vis->prompt_type == '/')
+		isearch.pos++;
+}
+
+/* search the next chunk of roughly len bytes, which is extended to a line
+ * boundary, and wrap around at the start/end of the file */
+static void isearch_step(size_t len) {
+	Text *txt = isearch.win->file->text;
+	size_t size = text_size(txt), start, end;
+	RegexMatch match[1];
+	bool found;
+	if (isearch.scanned >= size) {
+		isearch.pending = false;
+		return;
+	}
+	if (vis->prompt_type == '/') {
+		if (isearch.pos >= size)
+			isearch.pos = 0;
+		start = isearch.pos;
+		end = start + len < size ? text_line_next(txt, start + len) : size;
+		found = !text_search_range_forward(txt, start, end - start, isearch.regex, 1, match, 0);
+		isearch.pos = end;
+	} else {
+		if (isearch.pos == 0)
+			isearch.pos = size;
+		end = isearch.pos;
+		start = end > len ? text_line_begin(txt, end - len) : 0;
+		found = !text_search_range_backward(txt, start, end - start, isearch.regex, 1, match, 0);
+		isearch.pos = start;
+	}
+	isearch.scanned += end - start;
+	if (found) {
+		isearch.pending = false;
+		view_cursor_to(isearch.win->view, match[0].start);
+	}
+}
+
+static void isearch_stop(void) {
+	if (!isearch.win)
+		return;
+	view_viewport_set(isearch.win->view, isearch.viewport.start, isearch.cursor);
+	editor_search_highlight(vis, vis->hlsearch);
+	text_regex_free(isearch.regex);
+	free(isearch.pattern);
+	isearch.regex = NULL;
+	isearch.pattern = NULL;
+	isearch.win = NULL;
+	isearch.pending = false;
 }
 
 static void prompt_cmd(const Arg *arg) {
@@ -1158,6 +1396,8 @@ static void action_do(Action *a) {
 		.arg = &a->arg,
 	};
 
+	progress_start(txt, a->op ? "Processing" : "Searching");
+
 	if (a->movement) {
 		size_t start = pos;
 		for (int i = 0; i < count; i++) {
@@ -1249,7 +1489,11 @@ static void action_do(Action *a) {
 	}
 
 	if (a->op) {
-		view_cursor_to(view, a->op->func(&c));
+		if (!vis->cancelled)
+			pos = a->op->func(&c);
+		if (!progress_stop())
+			pos = c.pos;
+		view_cursor_to(view, pos);
 		editor_draw(vis);
 
 		if (vis->mode == &vis_modes[VIS_MODE_OPERATOR])
@@ -1257,6 +1501,8 @@ static void action_do(Action *a) {
 		else if (vis->mode->visual)
 			switchmode(&(const Arg){ .i = VIS_MODE_NORMAL });
 		text_snapshot(txt);
+	} else {
+		progress_stop();
 	}
 
 	if (a != &vis->action_prev) {
@@ -1329,6 +1575,19 @@ static bool cmd_set(Filerange *range, enum CmdOpt cmdopt, const char *argv[]) {
 		OPTION_SYNTAX,
 		OPTION_NUMBER,
 		OPTION_NUMBER_RELATIVE,
+		OPTION_HLSEARCH,
+		OPTION_MAXMEM,
+		OPTION_MEMLIMIT,
+		OPTION_INPLACE,
+		OPTION_REBASE,
+		OPTION_UNDOFILE,
+		OPTION_LINECACHE,
+		OPTION_RECOVERY,
+		OPTION_LARGEFILE,
+		OPTION_LARGELINE,
+		OPTION_MATCHCOUNT,
+		OPTION_FOLLOW,
+		OPTION_AUTORELOAD,
 	};
 
 	/* definitions have to be in the same order as the enum above */
@@ -1339,6 +1598,19 @@ static bool cmd_set(Filerange *range, enum CmdOpt cmdopt, const char *argv[]) {
 		[OPTION_SYNTAX]          = { { "syntax"                 }, OPTION_TYPE_STRING, true },
 		[OPTION_NUMBER]          = { { "numbers", "nu"          }, OPTION_TYPE_BOOL   },
 		[OPTION_NUMBER_RELATIVE] = { { "relativenumbers", "rnu" }, OPTION_TYPE_BOOL   },
+		[OPTION_HLSEARCH]        = { { "hlsearch", "hls"        }, OPTION_TYPE_BOOL   },
+		[OPTION_MAXMEM]          = { { "maxmem", "mm"           }, OPTION_TYPE_NUMBER },
+		[OPTION_MEMLIMIT]        = { { "memlimit", "ml"         }, OPTION_TYPE_NUMBER },
+		[OPTION_INPLACE]         = { { "inplace", "ip"          }, OPTION_TYPE_BOOL   },
+		[OPTION_REBASE]          = { { "rebase"                 }, OPTION_TYPE_STRING },
+		[OPTION_UNDOFILE]        = { { "undofile", "udf"        }, OPTION_TYPE_BOOL   },
+		[OPTION_LINECACHE]       = { { "linecache", "lc"        }, OPTION_TYPE_BOOL   },
+		[OPTION_RECOVERY]        = { { "recovery", "rcv"        }, OPTION_TYPE_BOOL   },
+		[OPTION_LARGEFILE]       = { { "largefile"              }, OPTION_TYPE_NUMBER },
+		[OPTION_LARGELINE]       = { { "largeline"              }, OPTION_TYPE_NUMBER },
+		[OPTION_MATCHCOUNT]      = { { "matchcount", "mc"       }, OPTION_TYPE_BOOL   },
+		[OPTION_FOLLOW]          = { { "follow"                 }, OPTION_TYPE_BOOL   },
+		[OPTION_AUTORELOAD]      = { { "autoreload", "ar"       }, OPTION_TYPE_BOOL   },
 	};
 
 	if (!vis->options) {
@@ -1426,7 +1698,10 @@ static bool cmd_set(Filerange *range, enum CmdOpt cmdopt, const char *argv[]) {
 
 		for (Syntax *syntax = syntaxes; syntax && syntax->name; syntax++) {
 			if (!strcasecmp(syntax->name, argv[2])) {
-				view_syntax_set(vis->win->view, syntax);
+				if (!view_syntax_set(vis->win->view, syntax)) {
+					editor_info_show(vis, "Could not compile syntax definition: `%s'", syntax->name);
+					return false;
+				}
 				return true;
 			}
 		}
@@ -1444,6 +1719,68 @@ static bool cmd_set(Filerange *range, enum CmdOpt cmdopt, const char *argv[]) {
 		editor_window_options(vis->win, arg.b ? UI_OPTION_LINE_NUMBERS_RELATIVE :
 			UI_OPTION_LINE_NUMBERS_NONE);
 		break;
+	case OPTION_HLSEARCH:
+		editor_search_highlight(vis, arg.b);
+		editor_draw(vis);
+		break;
+	case OPTION_MAXMEM:
+		editor_maxmem_set(vis, arg.i > 0 ? (size_t)arg.i << 20 : 0);
+		break;
+	case OPTION_MEMLIMIT:
+		editor_memlimit_set(vis, arg.i > 0 ? (size_t)arg.i << 20 : 0);
+		break;
+	case OPTION_INPLACE:
+		vis->inplace = arg.b;
+		break;
+	case OPTION_REBASE:
+		if (!strcmp(argv[2], "keep"))
+			vis->rebase = REBASE_KEEP;
+		else if (!strcmp(argv[2], "drop"))
+			vis->rebase = REBASE_DROP;
+		else if (parse_bool(argv[2], &arg.b) && !arg.b)
+			vis->rebase = REBASE_OFF;
+		else {
+			editor_info_show(vis, "Invalid rebase mode `%s', expected: keep, drop or off", argv[2]);
+			return false;
+		}
+		break;
+	case OPTION_UNDOFILE:
+		if (!editor_undofile_set(vis, arg.b)) {
+			editor_info_show(vis, "Can't create undo directory: %s", strerror(errno));
+			return false;
+		}
+		break;
+	case OPTION_LINECACHE:
+		if (!editor_linecache_set(vis, arg.b)) {
+			editor_info_show(vis, "Can't determine cache directory");
+			return false;
+		}
+		break;
+	case OPTION_RECOVERY:
+		editor_recovery_set(vis, arg.b);
+		break;
+	case OPTION_LARGEFILE:
+		vis->largefile = arg.i > 0 ? (size_t)arg.i << 20 : 0;
+		break;
+	case OPTION_LARGELINE:
+		vis->largeline = arg.i > 0 ? (size_t)arg.i << 10 : 0;
+		break;
+	case OPTION_MATCHCOUNT:
+		vis->win->matchcount = arg.b;
+		text_search_index(vis->win->file->text, arg.b ? vis->search_pattern : NULL);
+		vis->win->ui->draw_status(vis->win->ui);
+		break;
+	case OPTION_FOLLOW:
+		if (!editor_file_follow(vis, vis->win->file, arg.b)) {
+			editor_info_show(vis, "Can't follow file: %s", strerror(errno));
+			return false;
+		}
+		if (arg.b)
+			follow_step();
+		break;
+	case OPTION_AUTORELOAD:
+		vis->autoreload = arg.b;
+		break;
 	}
 
 	return true;
@@ -1463,7 +1800,28 @@ static bool cmd_open(Filerange *range, enum CmdOpt opt, const char *argv[]) {
 	return true;
 }
 
+/* wait for a background save of txt to complete and report whether it failed */
+static void save_finish(Text *txt) {
+	if (text_save_fd(txt) == -1)
+		return;
+	bool success = text_save_finish(txt);
+	if (!success)
+		editor_info_show(vis, "Can't write file: %s", strerror(errno));
+	for (File *file = vis->files; file; file = file->next) {
+		if (file->text == txt) {
+			if (success && file->rebase && vis->rebase != REBASE_OFF)
+				editor_file_rebase(vis, file, vis->rebase == REBASE_KEEP);
+			file->rebase = false;
+		}
+	}
+	for (Win *win = vis->windows; win; win = win->next) {
+		if (win->file->text == txt)
+			win->ui->draw_status(win->ui);
+	}
+}
+
 static bool is_view_closeable(Win *win) {
+	save_finish(win->file->text);
 	if (!text_modified(win->file->text))
 		return true;
 	return win->file->refcount > 1;
@@ -1508,6 +1866,7 @@ static bool cmd_xit(Filerange *range, enum CmdOpt opt, const char *argv[]) {
 
 static bool cmd_bdelete(Filerange *range, enum CmdOpt opt, const char *argv[]) {
 	Text *txt = vis->win->file->text;
+	save_finish(txt);
 	if (text_modified(txt) && !(opt & CMD_OPT_FORCE)) {
 		info_unsaved_changes();
 		return false;
@@ -1525,6 +1884,7 @@ static bool cmd_bdelete(Filerange *range, enum CmdOpt opt, const char *argv[]) {
 static bool cmd_qall(Filerange *range, enum CmdOpt opt, const char *argv[]) {
 	for (Win *next, *win = vis->windows; win; win = next) {
 		next = win->next;
+		save_finish(win->file->text);
 		if (!text_modified(vis->win->file->text) || (opt & CMD_OPT_FORCE))
 			editor_window_close(win);
 	}
@@ -1536,8 +1896,6 @@ static bool cmd_qall(Filerange *range, enum CmdOpt opt, const char *argv[]) {
 }
 
 static bool cmd_read(Filerange *range, enum CmdOpt opt, const char *argv[]) {
-	char cmd[255];
-
 	if (!argv[1]) {
 		editor_info_show(vis, "Filename or command expected");
 		return false;
@@ -1545,24 +1903,87 @@ static bool cmd_read(Filerange *range, enum CmdOpt opt, const char *argv[]) {
 
 	bool iscmd = (opt & CMD_OPT_FORCE) || argv[1][0] == '!';
 	const char *arg = argv[1]+(argv[1][0] == '!');
-	snprintf(cmd, sizeof cmd, "%s%s", iscmd ? "" : "cat ", arg);
 
 	size_t pos = view_cursor_get(vis->win->view);
+	Filerange cursor = { .start = pos, .end = pos };
 	if (!text_range_valid(range))
-		range = &(Filerange){ .start = pos, .end = pos };
+		range = &cursor;
 	Filerange delete = *range;
 	range->start = range->end;
 
-	bool ret = cmd_filter(range, opt, (const char*[]){ argv[0], "sh", "-c", cmd, NULL});
+	Text *text = vis->win->file->text;
+	if (!iscmd) {
+		/* expand ~, variables and globs like the shell used to do */
+		wordexp_t files;
+		if (wordexp(arg, &files, WRDE_NOCMD)) {
+			editor_info_show(vis, "Can't expand `%s'", arg);
+			return false;
+		}
+		if (!files.we_wordc) {
+			editor_info_show(vis, "No file name given by `%s'", arg);
+			wordfree(&files);
+			return false;
+		}
+		/* insert the files back to front to keep them in order */
+		for (size_t i = files.we_wordc; i-- > 0;) {
+			if (!text_insert_file(text, range->end, files.we_wordv[i])) {
+				editor_info_show(vis, "Can't read `%s': %s", files.we_wordv[i], strerror(errno));
+				text_revert(text);
+				wordfree(&files);
+				return false;
+			}
+		}
+		wordfree(&files);
+		text_delete(text, delete.start, delete.end - delete.start);
+		text_snapshot(text);
+		view_cursor_to(vis->win->view, delete.start);
+		return true;
+	}
+
+	bool ret = cmd_filter(range, opt, (const char*[]){ argv[0], "sh", "-c", arg, NULL});
 	if (ret)
-		text_delete(vis->win->file->text, delete.start, delete.end - delete.start);
+		text_delete(text, delete.start, delete.end - delete.start);
 	return ret;
 }
 
+static bool cmd_recover(Filerange *range, enum CmdOpt opt, const char *argv[]) {
+	Text *text = vis->win->file->text;
+	/* an interrupted write left the file itself inconsistent, handle it first */
+	if (text_journal_available(text)) {
+		if (opt & CMD_OPT_FORCE) {
+			text_journal_discard(text);
+			return true;
+		}
+		if (!text_journal_restore(text)) {
+			editor_info_show(vis, "Can't restore `%s': %s", text_filename_get(text), strerror(errno));
+			return false;
+		}
+		if (!editor_file_reload(vis, vis->win->file)) {
+			editor_info_show(vis, "Restored `%s', but can't reload it: %s",
+			                 text_filename_get(text), strerror(errno));
+			return false;
+		}
+		editor_draw(vis);
+		return true;
+	}
+	if (opt & CMD_OPT_FORCE) {
+		text_recovery_discard(text);
+		return true;
+	}
+	if (!text_recover(text)) {
+		editor_info_show(vis, "Can't recover `%s': %s", text_filename_get(text),
+		                 errno == EINVAL || errno == ENOENT ? "no matching journal" : strerror(errno));
+		return false;
+	}
+	editor_draw(vis);
+	return true;
+}
+
 static bool cmd_substitute(Filerange *range, enum CmdOpt opt, const char *argv[]) {
 	char pattern[255];
+	Filerange all = { .start = 0, .end = text_size(vis->win->file->text) };
 	if (!text_range_valid(range))
-		range = &(Filerange){ .start = 0, .end = text_size(vis->win->file->text) };
+		range = &all;
 	snprintf(pattern, sizeof pattern, "s%s", argv[1]);
 	return cmd_filter(range, opt, (const char*[]){ argv[0], "sed", pattern, NULL});
 }
@@ -1611,26 +2032,54 @@ static bool cmd_wq(Filerange *range, enum CmdOpt opt, const char *argv[]) {
 
 static bool cmd_write(Filerange *range, enum CmdOpt opt, const char *argv[]) {
 	Text *text = vis->win->file->text;
+	Filerange all = { .start = 0, .end = text_size(text) };
 	if (!text_range_valid(range))
-		range = &(Filerange){ .start = 0, .end = text_size(text) };
+		range = &all;
 	if (!argv[1])
 		argv[1] = text_filename_get(text);
 	if (!argv[1]) {
-		if (text_fd_get(text) == STDIN_FILENO) {
-			if (strchr(argv[0], 'q'))
-				return text_range_write(text, range, STDOUT_FILENO) >= 0;
+		if (text_fd_get(text) != -1) {
+			if (text_loading(text)) {
+				editor_info_show(vis, "Still reading from stdin");
+				return false;
+			}
+			if (strchr(argv[0], 'q')) {
+				progress_start(text, "Writing");
+				ssize_t written = text_range_write(text, range, STDOUT_FILENO);
+				return progress_stop() && written >= 0;
+			}
 			editor_info_show(vis, "No filename given, use 'wq' to write to stdout");
 			return false;
 		}
 		editor_info_show(vis, "Filename expected");
 		return false;
 	}
+	bool whole = range->start == 0 && range->end == all.end;
+	bool inplace = vis->inplace && whole;
+	const char *filename = text_filename_get(text);
+	/* whether the text can afterwards refer to the written file */
+	bool rebase = vis->rebase != REBASE_OFF && whole && !argv[2] && !strchr(argv[0], 'q') &&
+	              filename && !strcmp(argv[1], filename);
+	if (!inplace && !argv[2] && !strchr(argv[0], 'q') && text_range_size(range) >= BACKGROUND_SAVE_SIZE) {
+		if (text_range_save_start(text, range, argv[1])) {
+			vis->win->file->rebase = rebase;
+			return true;
+		}
+		editor_info_show(vis, "Can't write `%s': %s", argv[1], strerror(errno));
+		return false;
+	}
+	progress_start(text, "Writing");
 	for (const char **file = &argv[1]; *file; file++) {
-		if (!text_range_save(text, range, *file)) {
-			editor_info_show(vis, "Can't write `%s'", *file);
+		if (!(inplace ? text_save_inplace(text, *file) : text_range_save(text, range, *file))) {
+			if (progress_stop())
+				editor_info_show(vis, "Can't write `%s'", *file);
 			return false;
 		}
 	}
+	if (!progress_stop())
+		return false;
+	if (rebase)
+		editor_file_rebase(vis, vis->win->file, vis->rebase == REBASE_KEEP);
 	return true;
 }
 
@@ -1642,10 +2091,6 @@ static bool cmd_saveas(Filerange *range, enum CmdOpt opt, const char *argv[]) {
 	return false;
 }
 
-static void cancel_filter(int sig) {
-	vis->cancel_filter = true;
-}
-
 static bool cmd_filter(Filerange *range, enum CmdOpt opt, const char *argv[]) {
 	/* if an invalid range was given, stdin (i.e. key board input) is passed
 	 * through the external command. */
@@ -1671,6 +2116,7 @@ static bool cmd_filter(Filerange *range, enum CmdOpt opt, const char *argv[]) {
 		return false;
 	}
 
+	progress_start(text, "Filtering");
 	reset_shell_mode();
 	pid_t pid = fork();
 
@@ -1681,6 +2127,8 @@ static bool cmd_filter(Filerange *range, enum CmdOpt opt, const char *argv[]) {
 		close(pout[1]);
 		close(perr[0]);
 		close(perr[1]);
+		progress_stop();
+		reset_prog_mode();
 		editor_info_show(vis, "fork failure: %s", strerror(errno));
 		return false;
 	} else if (pid == 0) { /* child i.e filter */
@@ -1703,14 +2151,8 @@ static bool cmd_filter(Filerange *range, enum CmdOpt opt, const char *argv[]) {
 		exit(EXIT_FAILURE);
 	}
 
-	/* set up a signal handler to cancel the filter via CTRL-C */
-	struct sigaction sa, oldsa;
-	sa.sa_flags = 0;
-	sigemptyset(&sa.sa_mask);
-	sa.sa_handler = cancel_filter;
-
-	bool restore_signals = sigaction(SIGINT, &sa, &oldsa) == 0;
-	vis->cancel_filter = false;
+	/* the filter can be cancelled via CTRL-C */
+	progress_interruptible();
 
 	close(pin[0]);
 	close(pout[1]);
@@ -1719,8 +2161,9 @@ static bool cmd_filter(Filerange *range, enum CmdOpt opt, const char *argv[]) {
 	fcntl(pout[0], F_SETFL, O_NONBLOCK);
 	fcntl(perr[0], F_SETFL, O_NONBLOCK);
 
+	Filerange cursor = { .start = pos, .end = pos };
 	if (interactive)
-		range = &(Filerange){ .start = pos, .end = pos };
+		range = &cursor;
 
 	/* ranges which are written to the filter and read back in */
 	Filerange rout = *range;
@@ -1745,9 +2188,8 @@ static bool cmd_filter(Filerange *range, enum CmdOpt opt, const char *argv[]) {
 	buffer_init(&errmsg);
 
 	do {
-		if (vis->cancel_filter) {
+		if (vis->cancelled) {
 			kill(-pid, SIGTERM);
-			editor_info_show(vis, "Command cancelled");
 			break;
 		}
 
@@ -1768,10 +2210,11 @@ static bool cmd_filter(Filerange *range, enum CmdOpt opt, const char *argv[]) {
 		}
 
 		if (FD_ISSET(pin[1], &wfds)) {
-			Filerange junk = *range;
-			if (junk.end > junk.start + PIPE_BUF)
-				junk.end = junk.start + PIPE_BUF;
-			ssize_t len = text_range_write(text, &junk, pin[1]);
+			/* text_range_write would take a snapshot after every junk,
+			 * thereby breaking the undo/cancel of the whole operation */
+			char junk[PIPE_BUF];
+			size_t size = text_bytes_get(text, range->start, MIN(text_range_size(range), sizeof junk), junk);
+			ssize_t len = size > 0 ? write(pin[1], junk, size) : 0;
 			if (len > 0) {
 				range->start += len;
 				if (text_range_size(range) == 0) {
@@ -1826,18 +2269,17 @@ static bool cmd_filter(Filerange *range, enum CmdOpt opt, const char *argv[]) {
 	if (perr[0] != -1)
 		close(perr[0]);
 
-	if (waitpid(pid, &status, 0) == pid && status == 0) {
+	if (waitpid(pid, &status, 0) == pid && status == 0 && !vis->cancelled) {
 		text_delete(text, rout.start, rout.end - rout.start);
 		text_snapshot(text);
-	} else {
+	} else if (!vis->cancelled) {
 		/* make sure we have somehting to undo */
 		text_insert(text, pos, " ", 1);
 		text_undo(text);
 	}
 
-	view_cursor_to(view, rout.start);
-
-	if (!vis->cancel_filter) {
+	/* reverts the inserted output if the command was cancelled */
+	if (progress_stop()) {
 		if (status == 0)
 			editor_info_show(vis, "Command succeded");
 		else if (errmsg.len > 0)
@@ -1846,8 +2288,7 @@ static bool cmd_filter(Filerange *range, enum CmdOpt opt, const char *argv[]) {
 			editor_info_show(vis, "Command failed");
 	}
 
-	if (restore_signals)
-		sigaction(SIGTERM, &oldsa, NULL);
+	view_cursor_to(view, rout.start);
 
 	reset_prog_mode();
 	wclear(stdscr);
@@ -1884,14 +2325,11 @@ static Filepos parse_pos(char **cmd) {
 		if (!pattern_end)
 			return EPOS;
 		*pattern_end++ = '\0';
-		Regex *regex = text_regex_new();
-		if (!regex)
-			return EPOS;
-		if (!text_regex_compile(regex, *cmd, 0)) {
+		Regex *regex = editor_regex_get(vis, *cmd, 0);
+		if (regex) {
 			*cmd = pattern_end;
 			pos = text_search_forward(txt, view_cursor_get(view), regex);
 		}
-		text_regex_free(regex);
 		break;
 	case '+':
 	case '-':
@@ -2041,7 +2479,7 @@ static bool exec_command(char type, const char *cmd) {
 	switch (type) {
 	case '/':
 	case '?':
-		if (text_regex_compile(vis->search_pattern, cmd, REG_EXTENDED)) {
+		if (!editor_search_pattern_set(vis, cmd, REG_EXTENDED)) {
 			action_reset(&vis->action);
 			return false;
 		}
@@ -2061,15 +2499,51 @@ static void settings_apply(const char **settings) {
 		exec_cmdline_command(*opt);
 }
 
+/* tell the user about journals of a previous session which :recover handles */
+static void recovery_notify(Text *txt) {
+	if (text_journal_available(txt))
+		editor_info_show(vis, "Interrupted write of `%s' found, :recover restores the file, :recover! keeps it as is",
+		                 text_filename_get(txt));
+	else if (text_recovery_available(txt))
+		editor_info_show(vis, "Unsaved changes of a previous session found, :recover applies, :recover! discards them");
+}
+
 static bool vis_window_new(const char *file) {
 	if (!editor_window_new(vis, file))
 		return false;
+	recovery_notify(vis->win->file->text);
 	Syntax *s = view_syntax_get(vis->win->view);
 	if (s)
 		settings_apply(s->settings);
 	return true;
 }
 
+/* load the files of the focused and all other displayed windows which were
+ * created by editor_window_new_lazy, returns whether any was loaded */
+static bool windows_load(void) {
+	bool loaded = false;
+	Win *focus = vis->win;
+	for (Win *win = vis->windows; win; win = win->next) {
+		if (!win->file->lazy || (win != focus && view_height_get(win->view) <= 0))
+			continue;
+		char *name = strdup(win->file->lazy);
+		if (!editor_window_load(win)) {
+			editor_info_show(vis, "Can not load `%s': %s", name, strerror(errno));
+		} else {
+			recovery_notify(win->file->text);
+			/* the settings of its syntax apply to the window */
+			Syntax *s = view_syntax_get(win->view);
+			vis->win = win;
+			if (s)
+				settings_apply(s->settings);
+			vis->win = focus;
+		}
+		free(name);
+		loaded = true;
+	}
+	return loaded;
+}
+
 static bool vis_window_new_fd(int fd) {
 	if (!editor_window_new_fd(vis, fd))
 		return false;
@@ -2090,6 +2564,9 @@ static bool vis_window_split(Win *win) {
 
 static void die(const char *errstr, ...) {
 	va_list ap;
+	/* keep the unsaved modifications such that they can be recovered */
+	for (File *file = vis->files; file; file = file->next)
+		text_recovery_keep(file->text);
 	editor_free(vis);
 	va_start(ap, errstr);
 	vfprintf(stderr, errstr, ap);
@@ -2189,8 +2666,154 @@ static Key getkey(void) {
 	return key;
 }
 
+/* perform a bounded amount of background work while there is no user
+ * input, returns whether further work is pending */
+static bool background_work(void) {
+	Win *win = vis->prompt_window ? vis->prompt_window : vis->win;
+	if (!win)
+		return false;
+	if (isearch.win && isearch.revision != text_revision(vis->prompt->file->text))
+		isearch_update();
+	if (isearch.pending) {
+		isearch_step(BACKGROUND_CHUNK_SIZE);
+		return true;
+	}
+	if (text_search_index_update(win->file->text, BACKGROUND_CHUNK_SIZE))
+		return true;
+	/* index might have been completed, update match count */
+	win->ui->draw_status(win->ui);
+	return false;
+}
+
+/* append the available data of all files which are read from a pipe, windows
+ * are only redrawn if the new content (or the end of loading) is visible */
+static bool load_step(fd_set *fds) {
+	bool loaded = false, redraw = false;
+	for (File *file = vis->files; file; file = file->next) {
+		Text *txt = file->text;
+		if (!text_loading(txt) || !FD_ISSET(text_fd_get(txt), fds))
+			continue;
+		size_t size = text_size(txt);
+		if (text_load_more(txt, BACKGROUND_CHUNK_SIZE) == -1 && errno != EAGAIN)
+			editor_info_show(vis, "Error reading input: %s", strerror(errno));
+		loaded = true;
+		bool done = !text_loading(txt);
+		for (Win *win = vis->windows; win; win = win->next) {
+			if (win->file == file && (done || view_viewport_get(win->view).end >= size)) {
+				win->ui->draw(win->ui);
+				redraw = true;
+			}
+		}
+	}
+	/* position the cursor in the focused window */
+	if (redraw)
+		vis->win->ui->draw(vis->win->ui);
+	return loaded;
+}
+
+/* append the new data of all followed files. windows which showed the end of
+ * the file are redrawn, if the cursor was on the last line it is moved to the
+ * new one such that the view sticks to the bottom */
+static void follow_step(void) {
+	bool redraw = false;
+	for (File *file = vis->files; file; file = file->next) {
+		Text *txt = file->text;
+		size_t size = text_size(txt);
+		if (!file->follow)
+			continue;
+		ssize_t len = text_follow(txt);
+		if (len == -1 && errno == ERANGE) {
+			/* the file was truncated, its mapped data is no longer valid.
+			 * reloading it would discard the modifications and their history */
+			if (text_modified(txt)) {
+				editor_file_follow(vis, file, false);
+				editor_info_show(vis, "Stopped following `%s': it was truncated, "
+				                 "the text has unsaved changes", text_filename_get(txt));
+				continue;
+			}
+			if (editor_file_reload(vis, file)) {
+				editor_info_show(vis, "File was truncated, reloaded it");
+				continue;
+			}
+		}
+		if (len == -1) {
+			editor_file_follow(vis, file, false);
+			editor_info_show(vis, "Stopped following `%s': %s",
+			                 text_filename_get(txt), strerror(errno));
+		}
+		if (len <= 0)
+			continue;
+		size_t last = text_line_begin(txt, size > 0 ? size - 1 : 0);
+		for (Win *win = vis->windows; win; win = win->next) {
+			if (win->file != file || view_viewport_get(win->view).end < last)
+				continue;
+			/* the displayed lines are stale, lay them out anew */
+			view_draw(win->view);
+			if (view_cursor_get(win->view) >= last) {
+				size_t pos = text_line_begin(txt, text_size(txt) - 1);
+				/* scroll smoothly unless a lot of data was appended */
+				if ((size_t)len < BACKGROUND_CHUNK_SIZE)
+					view_scroll_to(win->view, pos);
+				else {
+					/* show the new end of file in the middle of the window */
+					view_cursor_to(win->view, text_size(txt));
+					view_cursor_to(win->view, pos);
+				}
+			}
+			win->ui->draw(win->ui);
+			redraw = true;
+		}
+	}
+	/* position the cursor in the focused window */
+	if (redraw)
+		vis->win->ui->draw(vis->win->ui);
+}
+
+/* check whether the file of the focused window was changed by another program.
+ * if so it is reloaded provided it is unmodified and autoreload is enabled,
+ * otherwise the user is told once */
+static void change_check(void) {
+	File *file = vis->win->file;
+	Text *txt = file->text;
+	if (text_save_fd(txt) != -1)
+		return;
+	bool changed = text_file_changed(txt);
+	if (!changed || file->changed) {
+		file->changed = changed;
+		return;
+	}
+	if (vis->autoreload && !text_modified(txt) && editor_file_reload(vis, file)) {
+		editor_info_show(vis, "File changed on disk, reloaded it");
+		return;
+	}
+	file->changed = true;
+	editor_info_show(vis, "File changed on disk, :e! reloads it");
+}
+
+/* complete finished background saves and update the progress of the others */
+static void save_step(fd_set *fds) {
+	for (File *file = vis->files; file; file = file->next) {
+		int fd = text_save_fd(file->text);
+		if (fd == -1)
+			continue;
+		if (FD_ISSET(fd, fds)) {
+			save_finish(file->text);
+			continue;
+		}
+		for (Win *win = vis->windows; win; win = win->next) {
+			if (win->file == file)
+				win->ui->draw_status(win->ui);
+		}
+	}
+}
+
 static void mainloop() {
 	struct timespec idle = { .tv_nsec = 0 }, *timeout = NULL;
+	struct timespec poll = { .tv_nsec = 0 };
+	struct timespec tick = { .tv_nsec = PROGRESS_UPDATE * 1000000 };
+	struct timespec recover = { .tv_sec = RECOVERY_IDLE };
+	time_t lastkey = 0, flushed = 0, checked = 0;
+	bool busy = true;
 	sigset_t emptyset, blockset;
 	sigemptyset(&emptyset);
 	sigemptyset(&blockset);
@@ -2204,19 +2827,69 @@ static void mainloop() {
 		fd_set fds;
 		FD_ZERO(&fds);
 		FD_SET(STDIN_FILENO, &fds);
+		int nfds = STDIN_FILENO;
+		bool saving = false, pending = false;
+		for (File *file = vis->files; file; file = file->next) {
+			pending |= text_recovery_pending(file->text);
+			if (text_loading(file->text)) {
+				int fd = text_fd_get(file->text);
+				FD_SET(fd, &fds);
+				nfds = MAX(nfds, fd);
+			}
+			int fd = text_save_fd(file->text);
+			if (fd != -1) {
+				FD_SET(fd, &fds);
+				nfds = MAX(nfds, fd);
+				saving = true;
+			}
+		}
+
+		int follow = editor_follow_fd(vis);
+		if (follow != -1) {
+			FD_SET(follow, &fds);
+			nfds = MAX(nfds, follow);
+		}
 
+		if (windows_load())
+			editor_draw(vis);
 		editor_update(vis);
 		idle.tv_sec = vis->mode->idle_timeout;
-		int r = pselect(1, &fds, NULL, NULL, timeout, &emptyset);
+		/* periodically redraw the progress of background saves */
+		struct timespec *wait = busy ? &poll : saving ? &tick : timeout;
+		if (pending && (!wait || wait->tv_sec >= RECOVERY_IDLE))
+			wait = &recover;
+		int r = pselect(nfds + 1, &fds, NULL, NULL, wait, &emptyset);
 		if (r == -1 && errno == EINTR)
 			continue;
 
-		if (r < 0) {
-			/* TODO save all pending changes to a ~suffixed file */
+		if (r < 0)
 			die("Error in mainloop: %s\n", strerror(errno));
+
+		/* new data might extend the match index */
+		if (r > 0 && load_step(&fds))
+			busy = true;
+		if (saving)
+			save_step(&fds);
+		if (follow != -1 && FD_ISSET(follow, &fds) && editor_follow_events(vis)) {
+			follow_step();
+			/* the match index has to cover the new data */
+			busy = true;
+		}
+
+		time_t now = time(NULL);
+		if (pending && !busy && (now - lastkey >= RECOVERY_IDLE || now - flushed >= RECOVERY_INTERVAL)) {
+			for (File *file = vis->files; file; file = file->next)
+				text_recovery_flush(file->text);
+			flushed = now;
 		}
 
 		if (!FD_ISSET(STDIN_FILENO, &fds)) {
+			if (busy || saving || pending) {
+				if (busy)
+					busy = background_work();
+				if (!timeout || time(NULL) - lastkey < idle.tv_sec)
+					continue;
+			}
 			if (vis->mode->idle)
 				vis->mode->idle();
 			timeout = NULL;
@@ -2225,7 +2898,17 @@ static void mainloop() {
 
 		Key key = getkey();
 		keypress(&key);
+		editor_readahead(vis);
+		editor_evict(vis);
+		/* the file might have been changed while the user was elsewhere */
+		if (now != checked) {
+			change_check();
+			checked = now;
+		}
+		/* input might have caused new background work */
+		busy = true;
 
+		lastkey = time(NULL);
 		if (vis->mode->idle)
 			timeout = &idle;
 	}
@@ -2271,19 +2954,36 @@ int main(int argc, char *argv[]) {
 			}
 		} else if (argv[i][0] == '+') {
 			cmd = argv[i] + (argv[i][1] == '/' || argv[i][1] == '?');
-		} else if (!vis_window_new(argv[i])) {
-			die("Can not load `%s': %s\n", argv[i], strerror(errno));
 		} else if (cmd) {
+			/* the command applies to the loaded file */
+			if (!vis_window_new(argv[i]))
+				die("Can not load `%s': %s\n", argv[i], strerror(errno));
 			exec_command(cmd[0], cmd+1);
 			cmd = NULL;
+		} else if (!editor_window_new_lazy(vis, argv[i])) {
+			/* files are only loaded once displayed, see windows_load */
+			die("Can not open `%s': %s\n", argv[i], strerror(errno));
 		}
 	}
 
 	if (!vis->windows) {
 		if (!strcmp(argv[argc-1], "-") || !isatty(STDIN_FILENO)) {
-			if (!vis_window_new_fd(STDIN_FILENO))
+			/* keep the pipe open, it is read from the mainloop */
+			int fd = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 0);
+			if (fd == -1 || !vis_window_new_fd(fd))
 				die("Can not read from stdin\n");
-			int fd = open("/dev/tty", O_RDONLY);
+			/* the terminal can't be shared with the input handling */
+			if (isatty(fd)) {
+				Text *txt = vis->win->file->text;
+				while (text_loading(txt))
+					text_load_more(txt, BACKGROUND_CHUNK_SIZE);
+			} else {
+				/* reading must not block the mainloop once the available data is consumed */
+				int flags = fcntl(fd, F_GETFL);
+				if (flags == -1 || fcntl(fd, F_SETFL, flags|O_NONBLOCK) == -1)
+					die("Can not read from stdin\n");
+			}
+			fd = open("/dev/tty", O_RDONLY);
 			if (fd == -1)
 				die("Can not reopen stdin\n");
 			dup2(fd, STDIN_FILENO);